@@ -3,6 +3,9 @@
 #include <fstream>
 #include <math.h>
 #include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
 #include "common.h"
 
 using namespace std;
@@ -11,6 +14,10 @@ typedef vector<long> memory_t;
 
 /**
  * Day 2 - Program Alarm
+ *
+ * Solution 2 does not brute-force all noun / verb pairs anymore: The program is executed
+ * symbolically, with noun and verb as variables. data[0] is then a polynomial in noun and verb,
+ * which can be solved for the target value directly.
  */
 
 long runProgram(memory_t &data)
@@ -54,6 +61,300 @@ long runProgram(memory_t &data)
     return data[0];
 }
 
+/**
+ * A polynomial in the two variables noun (n) and verb (v):
+ * Maps the exponents (of n, v) to the term's coefficient.
+ *
+ * A value read from a symbolic address is unknown: This is fine as long as it is
+ * overwritten before it is used as opcode, address or result.
+ */
+class Poly
+{
+    public:
+        map<pair<int, int>, long> terms;
+        bool unknown = false;
+
+        Poly() {}
+        Poly(long constant)
+        {
+            if (constant != 0)
+            {
+                terms[{0, 0}] = constant;
+            }
+        }
+
+        static Poly noun()
+        {
+            Poly p;
+            p.terms[{1, 0}] = 1;
+            return p;
+        }
+
+        static Poly verb()
+        {
+            Poly p;
+            p.terms[{0, 1}] = 1;
+            return p;
+        }
+
+        static Poly unknownValue()
+        {
+            Poly p;
+            p.unknown = true;
+            return p;
+        }
+
+        bool isConstant() const
+        {
+            return !unknown && (terms.empty() || (terms.size() == 1 && terms.begin()->first == make_pair(0, 0)));
+        }
+
+        long constant() const
+        {
+            auto it = terms.find({0, 0});
+            return it == terms.end() ? 0 : it->second;
+        }
+
+        int verbDegree() const
+        {
+            int degree = 0;
+            for (auto &t : terms)
+            {
+                degree = max(degree, t.first.second);
+            }
+            return degree;
+        }
+
+        /**
+         * Evaluates the terms with the given verb exponent for a concrete noun
+         */
+        long verbCoefficient(int verbExp, long noun) const
+        {
+            long sum = 0;
+            for (auto &t : terms)
+            {
+                if (t.first.second == verbExp)
+                {
+                    long power = 1;
+                    for (int e = 0; e < t.first.first; e++)
+                    {
+                        power *= noun;
+                    }
+                    sum += t.second * power;
+                }
+            }
+            return sum;
+        }
+
+        Poly operator+(const Poly &o) const
+        {
+            if (unknown || o.unknown)
+            {
+                return unknownValue();
+            }
+            Poly r(*this);
+            for (auto &t : o.terms)
+            {
+                r.terms[t.first] += t.second;
+                if (r.terms[t.first] == 0)
+                {
+                    r.terms.erase(t.first);
+                }
+            }
+            return r;
+        }
+
+        Poly operator*(const Poly &o) const
+        {
+            if (unknown || o.unknown)
+            {
+                return unknownValue();
+            }
+            Poly r;
+            for (auto &a : terms)
+            {
+                for (auto &b : o.terms)
+                {
+                    pair<int, int> exp{a.first.first + b.first.first, a.first.second + b.first.second};
+                    r.terms[exp] += a.second * b.second;
+                    if (r.terms[exp] == 0)
+                    {
+                        r.terms.erase(exp);
+                    }
+                }
+            }
+            return r;
+        }
+};
+
+ostream &operator<<(ostream &out, const Poly &p)
+{
+    if (p.unknown)
+    {
+        return out << "?";
+    }
+    if (p.terms.empty())
+    {
+        return out << "0";
+    }
+    bool first = true;
+    for (auto it = p.terms.rbegin(); it != p.terms.rend(); ++it)
+    {
+        out << (first ? "" : " + ") << it->second;
+        if (it->first.first > 0)
+        {
+            out << "*noun" << (it->first.first > 1 ? "^" + to_string(it->first.first) : "");
+        }
+        if (it->first.second > 0)
+        {
+            out << "*verb" << (it->first.second > 1 ? "^" + to_string(it->first.second) : "");
+        }
+        first = false;
+    }
+    return out;
+}
+
+/**
+ * Runs the program symbolically: data[1] (noun) and data[2] (verb) are variables,
+ * all other memory cells start as constants.
+ *
+ * Opcodes and store addresses must stay concrete - if the program would use a symbolic value as
+ * opcode or store address, we give up and return false. Reading from a symbolic address
+ * delivers an unknown value. Otherwise, result is the polynomial of data[0].
+ */
+bool runSymbolic(const memory_t &data, Poly &result)
+{
+    vector<Poly> mem;
+    mem.reserve(data.size());
+    for (auto v : data)
+    {
+        mem.push_back(Poly(v));
+    }
+    mem[1] = Poly::noun();
+    mem[2] = Poly::verb();
+
+    // Reads a memory cell that must be concrete (opcode / address), returns -1 if not possible:
+    auto concrete = [&](unsigned long pos) -> long {
+        if (pos >= mem.size() || !mem[pos].isConstant())
+        {
+            return -1;
+        }
+        return mem[pos].constant();
+    };
+    // Reads the value the parameter at pos points to, unknown if the address is symbolic:
+    auto load = [&](unsigned long pos) -> Poly {
+        long addr = concrete(pos);
+        if (addr < 0 || static_cast<unsigned long>(addr) >= mem.size())
+        {
+            return Poly::unknownValue();
+        }
+        return mem[addr];
+    };
+
+    unsigned long programPointer = 0;
+    while (programPointer < mem.size())
+    {
+        long opcode = concrete(programPointer);
+        if (opcode == 99)
+        {
+            result = mem[0];
+            return !result.unknown;
+        }
+        if (opcode != 1 && opcode != 2)
+        {
+            return false;
+        }
+        long storePos = concrete(programPointer + 3);
+        if (storePos < 0 || static_cast<unsigned long>(storePos) >= mem.size())
+        {
+            return false;
+        }
+        if (opcode == 1)
+        {
+            mem[storePos] = load(programPointer + 1) + load(programPointer + 2);
+        }
+        else
+        {
+            mem[storePos] = load(programPointer + 1) * load(programPointer + 2);
+        }
+        programPointer += 4;
+    }
+    return false;
+}
+
+/**
+ * Solves expr(noun, verb) == target for noun / verb in 0..99, if the expression is (at most)
+ * linear in verb: expr = A(noun) + B(noun) * verb, so for each noun, verb = (target - A) / B.
+ *
+ * The expression must be invertible this way (verbDegree() <= 1). Returns false if there is no solution.
+ */
+bool solveSymbolic(const Poly &expr, long target, long &noun, long &verb)
+{
+    for (long n = 0; n <= 99; n++)
+    {
+        long a = expr.verbCoefficient(0, n);
+        long b = expr.verbCoefficient(1, n);
+        if (b == 0)
+        {
+            if (a == target)
+            {
+                noun = n;
+                verb = 0;
+                return true;
+            }
+            continue;
+        }
+        if ((target - a) % b == 0)
+        {
+            long v = (target - a) / b;
+            if (v >= 0 && v <= 99)
+            {
+                noun = n;
+                verb = v;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Fallback: Brute-force all noun / verb pairs, the nouns are spread over all cores.
+ */
+bool solveBruteForce(const memory_t &data, long target, long &noun, long &verb)
+{
+    atomic<long> nextNoun{0};
+    atomic<bool> found{false};
+    vector<thread> workers;
+    unsigned int nrOfWorkers = max(1u, thread::hardware_concurrency());
+    for (unsigned int w = 0; w < nrOfWorkers; w++)
+    {
+        workers.push_back(thread([&]() {
+            memory_t workingData;
+            long n;
+            while (!found && (n = nextNoun.fetch_add(1)) <= 99)
+            {
+                for (long v = 0; v <= 99 && !found; v++)
+                {
+                    workingData = data;
+                    workingData[1] = n;
+                    workingData[2] = v;
+                    if (runProgram(workingData) == target && !found.exchange(true))
+                    {
+                        noun = n;
+                        verb = v;
+                    }
+                }
+            }
+        }));
+    }
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    return found;
+}
+
 int main(int argc, char *args[])
 {
     if (argc < 2)
@@ -74,21 +375,34 @@ int main(int argc, char *args[])
     runProgram(workingData);
     cout << "Solution 1: Data at pos 0 after program end: " << workingData[0] << endl;
 
-    // Solution 2: Modify both noun / verb from 0 - 99, to find solution 19690720
+    // Solution 2: Find noun / verb from 0 - 99, to find solution 19690720
     long solution = 19690720;
-    for (long noun = 0; noun <= 99; noun++)
+    long noun = 0, verb = 0;
+    bool found = false;
+    Poly expr;
+    bool symbolic = runSymbolic(data, expr);
+    if (symbolic)
     {
-        for (long verb = 0; verb <= 99; verb++)
+        cout << "Symbolic result: data[0] = " << expr << endl;
+    }
+    if (symbolic && expr.verbDegree() <= 1)
+    {
+        // The expression is exact: if it has no solution, brute force has none either
+        found = solveSymbolic(expr, solution, noun, verb);
+        if (!found)
         {
-            memory_t workingData(data);
-            workingData[1] = noun;
-            workingData[2] = verb;
-            if (runProgram(workingData) == solution)
-            {
-                cout << "Solution 2: Found solution " << solution << " with noun " << noun << ", verb " << verb << ", solution: 100*noun+verb = " << (100 * noun + verb) << endl;
-                exit(0);
-            }
+            cout << "Expression has no solution for noun / verb in 0..99" << endl;
         }
     }
+    else
+    {
+        cout << (symbolic ? "Expression not invertible" : "Program cannot be run symbolically") << ", fall back to brute force" << endl;
+        found = solveBruteForce(data, solution, noun, verb);
+    }
+    if (found)
+    {
+        cout << "Solution 2: Found solution " << solution << " with noun " << noun << ", verb " << verb << ", solution: 100*noun+verb = " << (100 * noun + verb) << endl;
+        exit(0);
+    }
     cout << "ERROR: No solution found!" << endl;
 }
@@ -1,6 +1,11 @@
 #include <iostream>
 #include <vector>
 #include <queue>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <map>
 #include "common.h"
 #include "intcode.h"
 
@@ -8,150 +13,407 @@ using namespace std;
 
 /**
  * Day 7 Part 2 - Amplification Circuit
+ *
+ * The phase permutations are searched in parallel: Each worker thread owns a set of
+ * pre-allocated amp programs, which are restored from shared (read-only) snapshots
+ * for each permutation: The snapshots are taken once per phase value, right after the
+ * amp program has consumed it. The highest signal is then reduced over all workers.
+ *
+ * In pipeline mode (--pipeline), each amp runs in its own thread instead, connected
+ * to its neighbours by lock-free channels.
  */
 
 
 /**
- * Create all permutations of the given vector
+ * Builds the n-th (0-based, lexicographical by index) permutation of the given phases,
+ * using the factorial number system. This way, no permutation list needs to be built up front.
  */
-void permute(vector<long> a, int l, int r, vector<vector<long>> &permutations)
+void nthPermutation(const vector<long> &phases, unsigned long n, vector<long> &permutation)
 {
-    // Base case
-    if (l == r)
-        permutations.push_back(a);
-    else
+    vector<long> pool(phases);
+    permutation.clear();
+    unsigned long fact = 1;
+    for (unsigned long i = 2; i < pool.size(); i++)
     {
-        // Permutations made
-        for (int i = l; i <= r; i++)
+        fact *= i;
+    }
+    for (unsigned long i = pool.size(); i > 0; i--)
+    {
+        unsigned long index = n / fact;
+        n %= fact;
+        permutation.push_back(pool[index]);
+        pool.erase(pool.begin() + index);
+        if (i > 1)
         {
-            // Swapping done
-            swap(a[l], a[i]);
-
-            // Recursion called
-            permute(a, l + 1, r, permutations);
-
-            //backtrack
-            swap(a[l], a[i]);
+            fact /= (i - 1);
         }
     }
 }
 
-void runSolution1(memory_t &data)
+/**
+ * Every amp starts by reading its phase value, which is always the same work for the same
+ * phase. So we run that prologue only once per distinct phase value, and take a snapshot
+ * of the program when it waits for the signal input (P_INPUT).
+ */
+map<long, Program *> buildPhaseSnapshots(const memory_t &data, const vector<long> &phases)
 {
-    vector<long> inputs{0, 1, 2, 3, 4};
-    vector<vector<long>> inputPermutations;
-    vector<Program *> ampPrograms;
-
-    // Permute inputs:
-    permute(inputs, 0, 4, inputPermutations);
-
-    cpp_int highest(0);
-    // Test 1:
-    // inputPermutations = vector<vector<long>>{{4,3,2,1,0}};
-    // Test 2:
-    // inputPermutations = vector<vector<long>>{{0,1,2,3,4}};
-    // Test 3:
-    // inputPermutations = vector<vector<long>>{{1,0,4,3,2}};
-    for (auto actPermutation : inputPermutations)
+    map<long, Program *> snapshots;
+    for (auto phase : phases)
     {
-        // Build amps:
-        for (auto p : ampPrograms)
+        if (snapshots.count(phase) > 0)
         {
-            delete p;
+            continue;
         }
-        ampPrograms.clear();
-
-        // Create 5 new amp programs:
-        for (int i = 0; i < 5; i++)
+        Program *p = new Program(&data);
+        p->inputValues.push(phase);
+        p->runProgram();
+        if (p->state != P_INPUT)
         {
-            Program *p = new Program(&data);
-            p->inputValues.push(actPermutation[i]);
-            p->pNr = i + 1;
-            ampPrograms.push_back(p);
+            cerr << "Error: amp program with phase " << phase << " does not wait for its signal input" << endl;
+            exit(1);
         }
+        snapshots[phase] = p;
+    }
+    return snapshots;
+}
+
+/**
+ * Runs the amp chain once for the given phase permutation, and returns the last
+ * amp's output signal.
+ *
+ * The amps are restored from the phase snapshots, so they can be re-used for each permutation.
+ * In feedback mode, the last amp's output is fed back to the first amp until the last amp halts.
+ */
+cpp_int runAmps(const map<long, Program *> &snapshots, vector<Program *> &ampPrograms, const vector<long> &permutation, bool feedback)
+{
+    for (vector<Program *>::size_type i = 0; i < ampPrograms.size(); i++)
+    {
+        *(ampPrograms[i]) = *(snapshots.at(permutation[i]));
+        ampPrograms[i]->pNr = i + 1;
+    }
+
+    if (!feedback)
+    {
         // Run programs on each amp:
         cpp_int inputValue(0);
-        for (vector<long>::size_type i = 0; i < ampPrograms.size(); i++)
+        for (vector<Program *>::size_type i = 0; i < ampPrograms.size(); i++)
         {
             ampPrograms[i]->inputValues.push(inputValue);
-            (ampPrograms[i])->runProgram();
+            ampPrograms[i]->runProgram();
             inputValue = ampPrograms[i]->output;
         }
-        if (inputValue > highest)
-        {
-            highest = inputValue;
-        }
+        return inputValue;
     }
-    for (auto p : ampPrograms)
+
+    // Run programs on each amp with feedback loop:
+    ampPrograms[0]->inputValues.push(0);
+    unsigned long i = 0;
+    unsigned long nextAmpIndex = 0;
+    Program *actAmp;
+    Program *nextAmp;
+    while (ampPrograms.back()->state != P_HALT)
     {
-        delete p;
+        i = i % ampPrograms.size(); // act amp, feedback loop counter
+        nextAmpIndex = (i + 1) % ampPrograms.size();
+        actAmp = ampPrograms[i];
+        nextAmp = ampPrograms[nextAmpIndex];
+        actAmp->runProgram();
+        // Feed the output of the act amp to the input of the next amp:
+        nextAmp->inputValues.push(actAmp->output);
+        i++;
     }
-    ampPrograms.clear();
-    cout << "Solution 1: Highest signal: " << highest << endl;
+    return ampPrograms.back()->output;
 }
 
-void runSolution2(memory_t &data)
+/**
+ * Searches all permutations of the given phases for the highest signal, using a pool of
+ * worker threads. Works for any number of amps (one amp per phase value, max. 20 because of N!).
+ */
+cpp_int findHighestSignal(const memory_t &data, const vector<long> &phases, bool feedback)
 {
-    vector<long> inputs{5, 6, 7, 8, 9};
-    vector<vector<long>> inputPermutations;
-    vector<Program *> ampPrograms;
+    if (phases.empty() || phases.size() > 20)
+    {
+        cerr << "Error: need 1 to 20 phase values, got " << phases.size() << endl;
+        exit(1);
+    }
+    unsigned long nrOfPermutations = 1;
+    for (unsigned long i = 2; i <= phases.size(); i++)
+    {
+        nrOfPermutations *= i;
+    }
 
-    // Permute inputs:
-    permute(inputs, 0, 4, inputPermutations);
+    // The snapshots are shared by all workers, read-only:
+    map<long, Program *> snapshots = buildPhaseSnapshots(data, phases);
 
-    cpp_int highest(0);
-    // Test 1:
-    // inputPermutations = vector<vector<long>>{{9,8,7,6,5}};
-    // Test 2:
-    // inputPermutations = vector<vector<long>>{{9,7,8,5,6}};
-    for (auto actPermutation : inputPermutations)
+    unsigned int nrOfWorkers = max(1u, thread::hardware_concurrency());
+    // Each worker fetches a chunk of permutation indices at a time:
+    const unsigned long chunkSize = 32;
+    atomic<unsigned long> nextIndex{0};
+    vector<cpp_int> highest(nrOfWorkers, cpp_int(0));
+    vector<thread> workers;
+
+    for (unsigned int w = 0; w < nrOfWorkers; w++)
+    {
+        workers.push_back(thread([&, w]() {
+            vector<Program *> ampPrograms;
+            for (vector<long>::size_type i = 0; i < phases.size(); i++)
+            {
+                ampPrograms.push_back(new Program(&data));
+            }
+            vector<long> permutation;
+            while (true)
+            {
+                unsigned long start = nextIndex.fetch_add(chunkSize);
+                if (start >= nrOfPermutations)
+                {
+                    break;
+                }
+                unsigned long end = min(start + chunkSize, nrOfPermutations);
+                for (unsigned long n = start; n < end; n++)
+                {
+                    nthPermutation(phases, n, permutation);
+                    cpp_int signal = runAmps(snapshots, ampPrograms, permutation, feedback);
+                    if (signal > highest[w])
+                    {
+                        highest[w] = signal;
+                    }
+                }
+            }
+            for (auto p : ampPrograms)
+            {
+                delete p;
+            }
+        }));
+    }
+    for (auto &t : workers)
     {
-        // Build amps:
-        for (auto p : ampPrograms)
+        t.join();
+    }
+    for (auto &it : snapshots)
+    {
+        delete it.second;
+    }
+    return *max_element(highest.begin(), highest.end());
+}
+
+/**
+ * A bounded, lock-free single-producer / single-consumer channel, connecting two
+ * amps in pipeline mode.
+ *
+ * The producer closes the channel when it halts: The consumer then reads the remaining
+ * values, and gets false from pop() afterwards. The consumer abandons the channel when it
+ * halts, so that the producer never blocks on a channel nobody reads from anymore.
+ */
+class Channel
+{
+    private:
+        vector<cpp_int> buffer;
+        size_t mask;
+        atomic<size_t> head{0};
+        atomic<size_t> tail{0};
+        atomic<bool> closed{false};
+        atomic<bool> abandoned{false};
+
+    public:
+        unsigned long transferred = 0;
+
+        // capacity must be a power of 2
+        Channel(size_t capacity) : buffer(capacity), mask(capacity - 1) {}
+
+        void push(const cpp_int &value)
+        {
+            size_t t = tail.load(memory_order_relaxed);
+            while (t - head.load(memory_order_acquire) > mask)
+            {
+                if (abandoned.load(memory_order_acquire))
+                {
+                    return;
+                }
+                this_thread::yield();
+            }
+            buffer[t & mask] = value;
+            tail.store(t + 1, memory_order_release);
+            transferred++;
+        }
+
+        bool pop(cpp_int &value)
+        {
+            size_t h = head.load(memory_order_relaxed);
+            while (h == tail.load(memory_order_acquire))
+            {
+                if (closed.load(memory_order_acquire))
+                {
+                    // re-check, the producer may have pushed right before closing:
+                    if (h == tail.load(memory_order_acquire))
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                this_thread::yield();
+            }
+            value = buffer[h & mask];
+            head.store(h + 1, memory_order_release);
+            return true;
+        }
+
+        void close()
+        {
+            closed.store(true, memory_order_release);
+        }
+
+        void abandon()
+        {
+            abandoned.store(true, memory_order_release);
+        }
+};
+
+/**
+ * An amp in pipeline mode: Reads its inputs from the channel of the previous amp,
+ * and writes its outputs to the channel of the next amp, without ever stopping for an output.
+ *
+ * If the input channel is closed (previous amp halted), the amp halts, too.
+ */
+class ChannelAmp : public ProgramBase<ChannelAmp>
+{
+    public:
+        Channel *in = nullptr;
+        Channel *out = nullptr;
+
+        ChannelAmp(const memory_t *mem) : ProgramBase<ChannelAmp>(mem) {}
+
+        bool hasInputValue()
         {
-            delete p;
+            return true;
         }
-        ampPrograms.clear();
 
-        // Create 5 new amp programs:
-        for (int i = 0; i < 5; i++)
+        cpp_int getInputValue()
         {
-            Program *p = new Program(&data);
-            p->inputValues.push(actPermutation[i]);
-            p->pNr = i + 1;
-            if (i == 0)
+            cpp_int val;
+            if (!in->pop(val))
             {
-                p->inputValues.push(0);
+                this->state = P_HALT;
             }
-            ampPrograms.push_back(p);
+            return val;
         }
 
-        // Run programs on each amp with feedback loop:
-        unsigned long i = 0;
-        unsigned long nextAmpIndex = 0;
-        Program *actAmp;
-        Program *nextAmp;
-        while (ampPrograms.back()->state != P_HALT)
+        bool handleOutputValue(const cpp_int &value)
         {
-            i = i % ampPrograms.size(); // act amp, feedback loop counter
-            nextAmpIndex = (i + 1) % ampPrograms.size();
-            actAmp = ampPrograms[i];
-            nextAmp = ampPrograms[nextAmpIndex];
-            actAmp->runProgram();
-            // Feed the output of the act amp to the input of the next amp:
-            nextAmp->inputValues.push(actAmp->output);
-            i++;
+            this->output = value;
+            out->push(value);
+            return false;
         }
-        if (ampPrograms.back()->output > highest)
+
+        /**
+         * Thread function: run until halt, then propagate the halt to the neighbours
+         */
+        void operator()()
         {
-            highest = ampPrograms.back()->output;
+            this->runProgram();
+            out->close();
+            in->abandon();
         }
+};
+
+/**
+ * Runs the amps as a pipeline in feedback mode: Each amp runs in its own thread,
+ * connected to its neighbours by channels. The last amp's channel closes the loop
+ * back to the first amp.
+ *
+ * Returns the last amp's final output. transferred is set to the number of values
+ * that were passed through the channels.
+ */
+cpp_int runPipeline(const memory_t &data, const vector<long> &phases, unsigned long &transferred)
+{
+    vector<Channel *> channels;
+    vector<ChannelAmp *> amps;
+    for (vector<long>::size_type i = 0; i < phases.size(); i++)
+    {
+        channels.push_back(new Channel(64));
+        amps.push_back(new ChannelAmp(&data));
+    }
+    for (vector<long>::size_type i = 0; i < phases.size(); i++)
+    {
+        // channel i is the input of amp i:
+        amps[i]->in = channels[i];
+        amps[i]->out = channels[(i + 1) % channels.size()];
+        amps[i]->pNr = i + 1;
+        channels[i]->push(phases[i]);
+    }
+    channels[0]->push(0);
+
+    vector<thread> threads;
+    for (auto amp : amps)
+    {
+        threads.push_back(thread(std::ref(*amp)));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    cpp_int signal = amps.back()->output;
+    transferred = 0;
+    for (vector<long>::size_type i = 0; i < phases.size(); i++)
+    {
+        transferred += channels[i]->transferred;
+        delete amps[i];
+        delete channels[i];
     }
-    for (auto p : ampPrograms)
+    return signal;
+}
+
+/**
+ * Pipeline mode benchmark: Runs a feedback chain with the given phases,
+ * and measures the channel throughput.
+ */
+void runPipelineBenchmark(memory_t &data, const vector<long> &phases)
+{
+    unsigned long nrOfStages = phases.size();
+    unsigned long transferred = 0;
+    auto start = chrono::steady_clock::now();
+    cpp_int signal = runPipeline(data, phases, transferred);
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - start).count();
+    cout << "Pipeline with " << nrOfStages << " stages: Output signal: " << signal << endl;
+    cout << "Transferred " << transferred << " values in " << seconds * 1000 << " ms ("
+         << static_cast<long>(transferred / seconds) << " values/s)" << endl;
+}
+
+/**
+ * Parses a phase list like "0,1,2,3,4"
+ */
+vector<long> parsePhases(const string &str)
+{
+    vector<string> parts;
+    vector<long> phases;
+    split(str, ',', parts);
+    for (auto p : parts)
     {
-        delete p;
+        phases.push_back(stol(p));
     }
-    ampPrograms.clear();
+    return phases;
+}
+
+void runSolution1(memory_t &data, const vector<long> &phases)
+{
+    // Test 1:
+    // phases {4,3,2,1,0}
+    // Test 2:
+    // phases {0,1,2,3,4}
+    // Test 3:
+    // phases {1,0,4,3,2}
+    cpp_int highest = findHighestSignal(data, phases, false);
+    cout << "Solution 1: Highest signal: " << highest << endl;
+}
+
+void runSolution2(memory_t &data, const vector<long> &phases)
+{
+    // Test 1:
+    // phases {9,8,7,6,5}
+    // Test 2:
+    // phases {9,7,8,5,6}
+    cpp_int highest = findHighestSignal(data, phases, true);
     std::cout << "Solution 2: Highest signal: " << highest << endl;
 }
 
@@ -160,6 +422,8 @@ int main(int argc, char *args[])
     if (argc < 2)
     {
         cerr << "Error: give input file on command line" << endl;
+        cerr << "Optional: phase sets for part 1 / part 2, e.g. 0,1,2,3,4 5,6,7,8,9" << endl;
+        cerr << "      or: --pipeline <nr of stages | phase list> to benchmark the threaded feedback pipeline" << endl;
         exit(1);
     }
 
@@ -167,6 +431,36 @@ int main(int argc, char *args[])
     memory_t data;
     readIntcodeProgramFromFile(args[1], data);
 
-    runSolution1(data);
-    runSolution2(data);
+    if (argc >= 4 && string("--pipeline").compare(args[2]) == 0)
+    {
+        // Either a phase list, or a nr of stages, using the phase values 5-9 repeatedly:
+        vector<long> phases;
+        if (string(args[3]).find(',') != string::npos)
+        {
+            phases = parsePhases(args[3]);
+        }
+        else
+        {
+            for (unsigned long i = 0; i < stoul(args[3]); i++)
+            {
+                phases.push_back(5 + (i % 5));
+            }
+        }
+        runPipelineBenchmark(data, phases);
+        return 0;
+    }
+
+    vector<long> phases1{0, 1, 2, 3, 4};
+    vector<long> phases2{5, 6, 7, 8, 9};
+    if (argc >= 3)
+    {
+        phases1 = parsePhases(args[2]);
+    }
+    if (argc >= 4)
+    {
+        phases2 = parsePhases(args[3]);
+    }
+
+    runSolution1(data, phases1);
+    runSolution2(data, phases2);
 }
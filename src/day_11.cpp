@@ -2,6 +2,11 @@
 #include <vector>
 #include <map>
 #include <queue>
+#include <unordered_map>
+#include <sstream>
+#include <thread>
+#include <climits>
+#include <cstdint>
 #include "common.h"
 #include "intcode.h"
 #include <boost/multiprecision/cpp_int.hpp>
@@ -17,43 +22,109 @@ using namespace cimg_library;
  */
 
 
-void start(memory_t &data, cpp_int startInput, const string& imgName) {
+/**
+ * A sparse grid of byte cells: The grid is made of fixed-size chunks of CHUNK_SIZE x CHUNK_SIZE cells,
+ * which are created on the first write. Chunks are found by their packed chunk coordinates,
+ * the last used chunk is cached, as the robot mostly stays within a chunk.
+ * The bounds of all written cells are tracked.
+ */
+class ChunkedGrid
+{
+public:
+    static const int CHUNK_BITS = 6;
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+    int minX = INT_MAX, maxX = INT_MIN, minY = INT_MAX, maxY = INT_MIN;
+
+    ~ChunkedGrid() {
+        for (auto &it : chunks) {
+            delete[] it.second;
+        }
+    }
+
+    /**
+     * Reads a cell, 0 if never written
+     */
+    unsigned char get(int x, int y) {
+        unsigned char *chunk = findChunk(x, y, false);
+        return chunk == nullptr ? 0 : chunk[cellIndex(x, y)];
+    }
+
+    /**
+     * Returns a cell for writing, and extends the bounds
+     */
+    unsigned char &at(int x, int y) {
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+        return findChunk(x, y, true)[cellIndex(x, y)];
+    }
+
+private:
+    unordered_map<long, unsigned char *> chunks;
+    long lastKey = 0;
+    unsigned char *lastChunk = nullptr;
+
+    static int cellIndex(int x, int y) {
+        return ((y & (CHUNK_SIZE - 1)) << CHUNK_BITS) | (x & (CHUNK_SIZE - 1));
+    }
+
+    unsigned char *findChunk(int x, int y, bool create) {
+        // >> rounds down, also for negative coordinates:
+        long key = (static_cast<long>(y >> CHUNK_BITS) << 32) | static_cast<uint32_t>(x >> CHUNK_BITS);
+        if (lastChunk != nullptr && key == lastKey) {
+            return lastChunk;
+        }
+        auto it = chunks.find(key);
+        unsigned char *chunk = nullptr;
+        if (it != chunks.end()) {
+            chunk = it->second;
+        } else if (create) {
+            chunk = new unsigned char[CHUNK_SIZE * CHUNK_SIZE]();
+            chunks[key] = chunk;
+        } else {
+            return nullptr;
+        }
+        lastKey = key;
+        lastChunk = chunk;
+        return chunk;
+    }
+};
+
+// Cell bits in the paint grid:
+const unsigned char CELL_WHITE = 1;
+const unsigned char CELL_PAINTED = 2;
+
+/**
+ * Runs the painting robot. All output goes to out, so that both solutions can run at the same time.
+ */
+void start(const memory_t &data, cpp_int startInput, const string& imgName, ostream &out) {
     Program program(&data);
-    map<string,cpp_int> paintArea;
+    ChunkedGrid paintArea;
+    unsigned long paintedTiles = 0;
     char dirs[] = {'U', 'R', 'D', 'L'};
     int dirIndex = 0;
     int coordX = 0, coordY = 0;
-    int minX = INT_MAX, maxX = INT_MIN, minY = INT_MAX, maxY = INT_MIN;
     cpp_int actInput;
-    bool firstRun = true;
+    if (startInput == 1) {
+        paintArea.at(0, 0) = CELL_WHITE;
+    }
     while (program.state != P_HALT) {
         // read the input (color) on the actual coords.
         // 0 / not set means black, 1 means white
-        string coordKey = to_string(coordX) + ":" + to_string(coordY);
-        map<string,cpp_int>::iterator findIt = paintArea.find(coordKey);
-        if (findIt == paintArea.end()) {
-            if (firstRun) {
-                actInput = startInput;
-            } else {
-                actInput = cpp_int(0);
-            }
-        } else {
-            actInput = findIt->second;
-        }
-        firstRun = false;
+        actInput = paintArea.get(coordX, coordY) & CELL_WHITE;
         // fill the actual color as program input, execute:
         program.inputValues.push(actInput);
         program.runProgram();
         if (program.state == P_OUTPUT) {
             // 1st output is the color to be painted:
-            actInput = program.output;
-            paintArea[coordKey] = actInput;
-            if (coordX < minX) minX = coordX;
-            if (coordX > maxX) maxX = coordX;
-            if (coordY < minY) minY = coordY;
-            if (coordY > maxY) maxY = coordY;
+            unsigned char &cell = paintArea.at(coordX, coordY);
+            if ((cell & CELL_PAINTED) == 0) {
+                paintedTiles++;
+            }
+            cell = CELL_PAINTED | (program.output == 1 ? CELL_WHITE : 0);
         } else {
-            cout << "End of program" << endl;
+            out << "End of program" << endl;
             break;
         }
         // start again, wait for 2nd output, the dir:
@@ -88,29 +159,28 @@ void start(memory_t &data, cpp_int startInput, const string& imgName) {
         }
 
     }
+    int minX = paintArea.minX, maxX = paintArea.maxX, minY = paintArea.minY, maxY = paintArea.maxY;
     int dX = maxX - minX;
     int dY = maxY - minY;
 
     // Draw an image / ASCII of the output
     CImg<unsigned char> pngImg(dX+4, dY+4, 1, 3, 0); // add a small border of 2 px per side
-    for (int y = minY; y <= maxX; ++y) {
+    for (int y = minY; y <= maxY; ++y) {
         for (int x = minX; x <= maxX; ++x) {
-            string coordKey = to_string(x) + ":" + to_string(y);
-            map<string,cpp_int>::iterator findIt = paintArea.find(coordKey);
-            if (findIt != paintArea.end() && findIt->second == 1) {
-                cout << "▦";
+            if (paintArea.get(x, y) & CELL_WHITE) {
+                out << "▦";
                 pngImg(x-minX+2, y-minY+2, 0, 0) = 255;
                 pngImg(x-minX+2, y-minY+2, 0, 1) = 255;
                 pngImg(x-minX+2, y-minY+2, 0, 2) = 255;
             } else {
-                cout << " ";
+                out << " ";
             }
         }
-        cout << endl;
+        out << endl;
     }
-    cout << "Number of painted tiles: " << paintArea.size() << endl;
+    out << "Number of painted tiles: " << paintedTiles << endl;
     pngImg.save_png(imgName.c_str());
-    cout << "Output image saved to: " << imgName << endl;
+    out << "Output image saved to: " << imgName << endl;
 }
 
 int main(int argc, char *args[])
@@ -125,11 +195,13 @@ int main(int argc, char *args[])
     memory_t data;
     readIntcodeProgramFromFile(args[1], data);
 
-    // Solution 1:
-    cout << "Solution 1" << endl;
-    start(data, cpp_int(0), "day_11_solution1.png");
-    cout << endl <<endl << "Solution 2" << endl;
+    // Both solutions run at the same time, each on its own program:
+    ostringstream out1, out2;
+    thread run1(start, std::cref(data), cpp_int(0), "day_11_solution1.png", std::ref(out1));
+    thread run2(start, std::cref(data), cpp_int(1), "day_11_solution2.png", std::ref(out2));
+    run1.join();
+    run2.join();
 
-    // Solution 2:
-    start(data, cpp_int(1), "day_11_solution2.png");
+    cout << "Solution 1" << endl << out1.str();
+    cout << endl <<endl << "Solution 2" << endl << out2.str();
 }
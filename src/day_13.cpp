@@ -6,8 +6,9 @@
 #include "common.h"
 #include "intcode.h"
 #include <boost/multiprecision/cpp_int.hpp>
-#include <thread>
 #include <chrono>
+#include <string>
+#include <cstring>
 
 using namespace std;
 using namespace boost::multiprecision;
@@ -15,6 +16,14 @@ using namespace boost;
 
 /**
  * Day 13 - Care Package
+ *
+ * The game runs headless at full speed: The program never stops for outputs, the
+ * (x, y, tile) triples are applied to the field directly. With --display, the field is rendered
+ * incrementally, with a capped frame rate.
+ *
+ * The final score is also predicted from the program's memory, without playing (see analyzeScore);
+ * if the memory does not fit that analysis, the game is just played. With --predict the game is not
+ * played at all.
  */
 
 /**
@@ -32,14 +41,145 @@ int paddleX;
 int field[50][50];
 
 /**
- * Override program class to read inputs from Joystick values
+ * Renders the play field incrementally with ANSI escape sequences: Only the cells that changed
+ * since the last frame are redrawn, and at most framesPerSecond frames are drawn - independent of how
+ * fast the game itself runs.
  */
-class JoystickInputProgram : public Program
+class Renderer
 {
     public:
-        JoystickInputProgram(memory_t *mem) : Program(mem) {}
+        Renderer(int framesPerSecond) : frameInterval{chrono::microseconds(1000000 / max(1, framesPerSecond))}
+        {
+            for (int x = 0; x < 50; x++)
+            {
+                for (int y = 0; y < 50; y++)
+                {
+                    drawn[x][y] = -1;
+                }
+            }
+            // clear screen, hide cursor:
+            cout << "\033[2J\033[?25l";
+        }
+
+        ~Renderer()
+        {
+            // show cursor again, move below the field:
+            cout << "\033[" << height + 2 << ";1H\033[?25h" << flush;
+        }
+
+        /**
+         * Draws a frame, if the last one is long enough ago (or force is set)
+         */
+        void render(int points, bool force)
+        {
+            auto now = chrono::steady_clock::now();
+            if (!force && now - lastFrame < frameInterval)
+            {
+                return;
+            }
+            lastFrame = now;
+            string frame;
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    if (drawn[x][y] != field[x][y])
+                    {
+                        drawn[x][y] = field[x][y];
+                        frame += "\033[" + to_string(y + 1) + ";" + to_string(x + 1) + "H" + tileChar(field[x][y]);
+                    }
+                }
+            }
+            frame += "\033[" + to_string(height + 1) + ";1HPoints: " + to_string(points);
+            cout << frame << flush;
+            frames++;
+        }
+
+        unsigned long frames = 0;
 
-        cpp_int getInputValue() override {
+    private:
+        chrono::microseconds frameInterval;
+        chrono::steady_clock::time_point lastFrame;
+        int drawn[50][50];
+
+        static const char *tileChar(int tile)
+        {
+            switch (tile)
+            {
+                case 1:
+                    return "▦"; // wall
+                case 2:
+                    return "▣"; // block
+                case 3:
+                    return "▬"; // paddle
+                case 4:
+                    return "●"; // ball
+                default:
+                    return " ";
+            }
+        }
+};
+
+/**
+ * Updates the field and bookkeeping with a (x, y, tile) output triple.
+ * Returns true if the ball has moved.
+ */
+bool updateTile(int x, int y, int tile, int &points)
+{
+    // Point value is delivered: x=-1, y=0, value=points
+    if (x == -1 && y == 0)
+    {
+        points = tile;
+        return false;
+    }
+    if (x >= width)
+        width = x + 1;
+    if (y >= height)
+        height = y + 1;
+    if (tile == 3)
+    {
+        // paddle paint
+        paddleX = x;
+    }
+    // Update field, bookkeeping:
+    if (field[x][y] == 2 && tile != 2)
+    {
+        // Block destroyed;
+        countBlockTiles--;
+    }
+    else if (field[x][y] != 2 && tile == 2)
+    {
+        countBlockTiles++;
+    }
+    field[x][y] = tile;
+    if (tile == 4)
+    {
+        // ball paint
+        ballX = x;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Program driver that reads inputs from Joystick values
+ *
+ * Outputs are collected as (x, y, tile) triples and applied to the field directly,
+ * so the program never stops for an output: the game runs at full VM speed.
+ */
+class JoystickInputProgram : public ProgramBase<JoystickInputProgram>
+{
+    public:
+        int points = 0;
+        Renderer *renderer = nullptr;
+
+        JoystickInputProgram(memory_t *mem) : ProgramBase<JoystickInputProgram>(mem) {}
+
+        bool hasInputValue() {
+            return true;
+        }
+
+        cpp_int getInputValue() {
             if (ballX < paddleX)
             {
                 return cpp_int(-1);
@@ -50,6 +190,23 @@ class JoystickInputProgram : public Program
             }
             return cpp_int(0);
         }
+
+        bool handleOutputValue(const cpp_int &value) {
+            triple[tripleCount++] = static_cast<int>(value);
+            if (tripleCount == 3)
+            {
+                tripleCount = 0;
+                if (updateTile(triple[0], triple[1], triple[2], points) && renderer != nullptr)
+                {
+                    renderer->render(points, false);
+                }
+            }
+            return false;
+        }
+
+    private:
+        int triple[3];
+        int tripleCount = 0;
 };
 
 
@@ -92,69 +249,242 @@ void printField()
     }
 }
 
-void solution1(memory_t &data)
+/**
+ * Static score analysis: Predicts the final score without playing the game.
+ *
+ * The program keeps the play field as a width x height tile grid in its memory, followed by
+ * a score table of the same size. When the ball destroys a block, a small hash function maps
+ * the block's (x, y) to an entry of the score table, and the game ends when all blocks are gone -
+ * so the final score is the sum of the score entries of all blocks.
+ *
+ * We locate the grid by matching it against the drawn field, find the hash function (the function that
+ * references the score table), and call it for each block on a probe VM.
+ */
+class ScoreAnalysis
 {
-    JoystickInputProgram program(&data);
-    map<string, vector<cpp_int>> paintArea;
-    vector<cpp_int> values;
-    cpp_int actInput;
-    while (program.state != P_HALT)
+    public:
+        long gridBase = -1;
+        long tableBase = -1;
+        long scoreFunction = -1;
+        // block (x, y) -> address of its score entry
+        map<pair<int, int>, long> scoreAddresses;
+        long predictedScore = 0;
+};
+
+/**
+ * Finds the start address of the tile grid: the memory region that contains the
+ * drawn field (row by row).
+ */
+long findTileGrid(const vector<long> &mem)
+{
+    long size = width * height;
+    for (long base = 0; base + size <= static_cast<long>(mem.size()); base++)
+    {
+        bool match = true;
+        for (int y = 0; y < height && match; y++)
+        {
+            for (int x = 0; x < width && match; x++)
+            {
+                match = mem[base + y * width + x] == field[x][y];
+            }
+        }
+        if (match)
+        {
+            return base;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finds the function that calculates the score address: It references the
+ * score table's base address as a constant. Functions are called with jump-if-true / -false
+ * instructions with immediate parameters only ("jt #1 #function", "jf #0 #function"), so the function's
+ * entry is the nearest call target before that reference.
+ */
+long findScoreFunction(const vector<long> &mem, long tableBase)
+{
+    long reference = -1;
+    for (long i = 1; i < static_cast<long>(mem.size()) && reference < 0; i++)
     {
-        program.runProgram();
-        if (program.state == P_OUTPUT)
+        if (mem[i] == tableBase)
         {
-            // 1st output is the x-value:
-            actInput = program.output;
-            values.push_back(actInput);
-            // start again, to wait for 2nd output (y value)
-            program.runProgram();
-            actInput = program.output;
-            values.push_back(actInput);
-            // start again, to wait for 3rd output (stone value)
-            program.runProgram();
-            actInput = program.output;
-            values.push_back(actInput);
+            reference = i;
         }
-        else
+    }
+    long function = -1;
+    for (long i = 0; i + 2 < static_cast<long>(mem.size()); i++)
+    {
+        long opcode = mem[i] % 100;
+        bool immediate = (mem[i] / 100) % 10 == 1 && (mem[i] / 1000) % 10 == 1;
+        bool call = (opcode == 5 && mem[i + 1] != 0) || (opcode == 6 && mem[i + 1] == 0);
+        if (immediate && call && mem[i + 2] < reference && mem[i + 2] > function)
         {
-            cout << "End of program" << endl;
-            break;
+            function = mem[i + 2];
         }
     }
-    int tile = 0;
-    int x = 0, y = 0;
-    for (unsigned int i = 0; i < values.size(); i += 3)
+    return function;
+}
+
+/**
+ * Calls the score function for a block on the probe VM: The function gets its return address
+ * at relativeBase + 0 and (x, y) at relativeBase + 1 / + 2, and returns its result at relativeBase + 1.
+ * We let it return to a halt instruction right below the frame (above it, the function
+ * and its callees use the stack).
+ */
+long probeScoreAddress(Program &probe, long function, long frame, int x, int y)
+{
+    memory_t &mem = *probe.memory;
+    mem[cpp_int(frame - 1)] = 99;
+    mem[cpp_int(frame)] = frame - 1;
+    mem[cpp_int(frame + 1)] = x;
+    mem[cpp_int(frame + 2)] = y;
+    probe.iPointer = function;
+    probe.relativeBase = frame;
+    probe.state = P_RUN;
+    if (!probe.runProgramLimited(100000) || probe.state != P_HALT)
+    {
+        return -1;
+    }
+    return static_cast<long>(mem[cpp_int(frame + 1)]);
+}
+
+/**
+ * A copy of the game globals, restored when it goes out of scope:
+ * a game played on the side must not change what the real game has drawn.
+ */
+class SavedGameState
+{
+    public:
+        SavedGameState()
+            : countBlockTiles{::countBlockTiles}, width{::width}, height{::height}, ballX{::ballX}, paddleX{::paddleX}
+        {
+            memcpy(field, ::field, sizeof(field));
+        }
+
+        ~SavedGameState()
+        {
+            ::countBlockTiles = countBlockTiles;
+            ::width = width;
+            ::height = height;
+            ::ballX = ballX;
+            ::paddleX = paddleX;
+            memcpy(::field, field, sizeof(field));
+        }
+
+    private:
+        int countBlockTiles;
+        int width;
+        int height;
+        int ballX;
+        int paddleX;
+        int field[50][50];
+};
+
+/**
+ * Plays the first part of the game, until points were scored nrOfHits times, and checks the points
+ * each time against the score entries of the blocks destroyed so far.
+ * The game is stepped by single instructions, so we see each score output before the next block is hit.
+ * The game globals are restored afterwards.
+ */
+bool confirmWithGame(const memory_t &data, const ScoreAnalysis &analysis, const vector<long> &mem, int nrOfHits)
+{
+    SavedGameState saved;
+    memory_t gameData(data);
+    gameData[cpp_int(0)] = 2;
+    JoystickInputProgram game(&gameData);
+    int lastPoints = 0;
+    for (int hit = 0; hit < nrOfHits; hit++)
     {
-        x = static_cast<int>(values[i]);
-        y = static_cast<int>(values[i + 1]);
-        tile = static_cast<int>(values[i + 2]);
-        if (x == 0)
+        while (game.points == lastPoints)
         {
-            cout << endl;
+            if (game.runProgramLimited(1) && game.state == P_HALT)
+            {
+                return false;
+            }
         }
-        if (x > width)
-            width = x;
-        if (y > height)
-            height = y;
-        field[x][y] = tile;
-        if (tile == 2)
+        lastPoints = game.points;
+        long expected = 0;
+        for (auto &block : analysis.scoreAddresses)
         {
-            // block
-            countBlockTiles++;
+            if (field[block.first.first][block.first.second] != 2)
+            {
+                expected += mem[block.second];
+            }
         }
-        if (tile == 3)
+        if (expected != game.points)
         {
-            // Paddle
-            paddleX = x;
+            return false;
         }
-        if (tile == 4)
+    }
+    return true;
+}
+
+/**
+ * Predicts the final score from the program's memory (after solution1 has drawn the field).
+ * Returns false if the memory layout does not fit the expected one.
+ */
+bool analyzeScore(const memory_t &data, ScoreAnalysis &analysis)
+{
+    vector<long> mem;
+    for (auto &entry : data)
+    {
+        long addr = static_cast<long>(entry.first);
+        if (addr >= static_cast<long>(mem.size()))
         {
-            //Ball
-            ballX = x;
+            mem.resize(addr + 1, 0);
         }
+        mem[addr] = static_cast<long>(entry.second);
+    }
+
+    analysis.gridBase = findTileGrid(mem);
+    if (analysis.gridBase < 0)
+    {
+        cerr << "Score analysis: tile grid not found" << endl;
+        return false;
+    }
+    analysis.tableBase = analysis.gridBase + width * height;
+    analysis.scoreFunction = findScoreFunction(mem, analysis.tableBase);
+    if (analysis.scoreFunction < 0)
+    {
+        cerr << "Score analysis: score function not found" << endl;
+        return false;
     }
-    width++;
-    height++;
+
+    // Probe the score function for all blocks, the results must lie in the score table:
+    Program probe(&data);
+    long frame = mem.size() + 100;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (field[x][y] != 2)
+            {
+                continue;
+            }
+            long addr = probeScoreAddress(probe, analysis.scoreFunction, frame, x, y);
+            if (addr < analysis.tableBase || addr >= analysis.tableBase + width * height)
+            {
+                cerr << "Score analysis: probe for block " << x << "," << y << " does not hit the score table" << endl;
+                return false;
+            }
+            analysis.scoreAddresses[{x, y}] = addr;
+            analysis.predictedScore += mem[addr];
+        }
+    }
+
+    if (!confirmWithGame(data, analysis, mem, 10))
+    {
+        cerr << "Score analysis: game probe does not match the score table" << endl;
+        return false;
+    }
+    return true;
+}
+
+void solution1(memory_t &data)
+{
+    JoystickInputProgram program(&data);
+    program.runProgram();
     printField();
     cout << endl
          << "Field size: " << width << " x " << height << endl;
@@ -163,77 +493,38 @@ void solution1(memory_t &data)
     cout << "Solution 1: " << countBlockTiles << endl;
 }
 
-void solution2(memory_t &data, bool withDisplay)
+/**
+ * Plays the game. Headless by default, at full speed.
+ * If framesPerSecond > 0, the game is rendered incrementally, with at most that frame rate.
+ */
+int solution2(memory_t &data, int framesPerSecond)
 {
     // Insert free coin:
     data[cpp_int(0)] = 2;
 
     JoystickInputProgram program(&data);
-
-    printField();
-
-    // Play!
-    int readX = 0, readY = 0, val = 0, points = 0;
-    while (program.state != P_HALT)
+    Renderer *renderer = nullptr;
+    if (framesPerSecond > 0)
     {
-        program.runProgram();
-        if (program.state == P_OUTPUT)
-        {
-            // 1st output is the x-value:
-            readX = static_cast<int>(program.output);
-
-            // 2nd value is the y-value
-            program.runProgram();
-            readY = static_cast<int>(program.output);
+        renderer = new Renderer(framesPerSecond);
+        program.renderer = renderer;
+    }
 
-            // 3rd value is the tile value
-            program.runProgram();
-            val = static_cast<int>(program.output);
+    // Play!
+    auto start = chrono::steady_clock::now();
+    program.runProgram();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-            // Point value is delivered: x=-1, y=0, value=points
-            if (readX == -1 && readY == 0)
-            {
-                points = val;
-            }
-            else
-            {
-                if (val == 3)
-                {
-                    // paddle paint
-                    paddleX = readX;
-                }
-                if (val == 4)
-                {
-                    // ball paint
-                    ballX = readX;
-                }
-                // Update field, bookkeeping:
-                if (field[readX][readY] == 2)
-                {
-                    // Block update
-                    if (val != 2)
-                    {
-                        // Block destroyed;
-                        countBlockTiles--;
-                        // cout << "Block destroyed. Remaining: " << countBlockTiles << endl;
-                    }
-                }
-                field[readX][readY] = val;
-                if (withDisplay && val == 4) {
-                    printField();
-                    cout << "Points: " << points << endl;
-                    std::chrono::milliseconds timespan(10);
-                    std::this_thread::sleep_for(timespan);
-                }
-            }
-        }
-        else
-        {
-            cout << "End of program" << endl;
-            break;
-        }
+    if (renderer != nullptr)
+    {
+        renderer->render(program.points, true);
+        unsigned long frames = renderer->frames;
+        delete renderer;
+        cout << "Rendered " << frames << " frames" << endl;
     }
-    cout << "Solution 2: Points after game has ended: " << points << endl;
+    cout << "Game played in " << ms << " ms, " << program.executedInstructions << " instructions" << endl;
+    cout << "Solution 2: Points after game has ended: " << program.points << endl;
+    return program.points;
 }
 
 int main(int argc, char *args[])
@@ -249,5 +540,47 @@ int main(int argc, char *args[])
     readIntcodeProgramFromFile(args[1], data);
 
     solution1(data);
-    solution2(data, argc >= 3 && string("--display").compare(args[2]) == 0 ? true : false);
+
+    // Predict the score from the memory, with the field drawn by solution1. This is a heuristic:
+    // if the memory layout does not fit, the game is just played.
+    bool predictOnly = argc >= 3 && string("--predict").compare(args[2]) == 0;
+    auto start = chrono::steady_clock::now();
+    ScoreAnalysis analysis;
+    bool predicted = analyzeScore(data, analysis);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (predicted)
+    {
+        cout << "Score analysis: tile grid at " << analysis.gridBase << ", score table at " << analysis.tableBase
+             << ", score function at " << analysis.scoreFunction << endl;
+        cout << "Predicted score: " << analysis.predictedScore << " (" << analysis.scoreAddresses.size()
+             << " blocks, " << ms << " ms)" << endl;
+    }
+    else if (predictOnly)
+    {
+        cerr << "Error: the score cannot be predicted for this program" << endl;
+        exit(1);
+    }
+    else
+    {
+        cout << "Score analysis failed, playing the game without prediction" << endl;
+    }
+
+    // --predict: no need to play the game
+    if (predictOnly)
+    {
+        return 0;
+    }
+
+    // --display [fps]: render the game, with max. fps frames per second (default: 30)
+    int framesPerSecond = 0;
+    if (argc >= 3 && string("--display").compare(args[2]) == 0)
+    {
+        framesPerSecond = argc >= 4 ? stoi(args[3]) : 30;
+    }
+    int points = solution2(data, framesPerSecond);
+    if (predicted && points != analysis.predictedScore)
+    {
+        cerr << "Predicted score " << analysis.predictedScore << " does not match the played score " << points << endl;
+        exit(1);
+    }
 }
@@ -3,6 +3,11 @@
 #include <vector>
 #include <map>
 #include <queue>
+#include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <cstdint>
 #include "common.h"
 #include "intcode.h"
 #include <thread>
@@ -13,7 +18,7 @@ using namespace std;
 /**
  * Day 15 - Oxygen System
  *
- * Classical backtrack problem - at least for part 1.
+ * Part 1 is a maze exploration: done as a BFS with a forked droid program per frontier cell.
  */
 
 class Point
@@ -24,9 +29,16 @@ public:
     char object = -1;
 };
 
-map<string, Point *> coords;
+unordered_map<long, Point *> coords;
 vector<vector<Point *>> floorMap;
 
+/**
+ * Packs a coordinate into a single map key
+ */
+long pointKey(int x, int y)
+{
+    return (static_cast<long>(y) << 32) | static_cast<uint32_t>(x);
+}
 
 /**
  * Returns true if the position was new, so not yet visited,
@@ -38,7 +50,7 @@ vector<vector<Point *>> floorMap;
  */
 bool markPosition(int x, int y, char object)
 {
-    string key = to_string(x) + ":" + to_string(y);
+    long key = pointKey(x, y);
     if (coords.count(key) == 0)
     {
         Point *p = new Point();
@@ -60,118 +72,136 @@ bool markPosition(int x, int y, char object)
  */
 bool checkPosition(int x, int y)
 {
-    string key = to_string(x) + ":" + to_string(y);
-    return coords.count(key) == 0;
+    return coords.count(pointKey(x, y)) == 0;
 }
 
 /**
- * The workhorse for Solution 1: The backtrack mapping alrogithm:
- *
- * *** Assumption ***: This is a straight forward maze, with no loops and only one
- * way to the exit .... may be this is a FALSE assumption, I don't know yet...
- * we are at starX, starty.
- * Main idea is to:
- * - walk in each direction:
- * - if a wall is hit, return "wall"
- * - if we can walk, recurse:
- *   - if recursion was successful, found the target, count steps
- *     In this case, backtrack again, to find a (possibly) shorter way.
- *   - if recursion hit a wall, move robot back to its startX, startY, backtrack
+ * A repair droid on a cell of the BFS frontier, with its own forked program
  */
-cpp_int walk(Program *p, int startX, int startY, int moveCounter)
+class Droid
 {
-    int origX = startX;
-    int origY = startY;
+public:
+    int x = 0;
+    int y = 0;
+    Program *program = nullptr;
+};
 
-    vector<int> dirs{1, 4, 2, 3}; // north, east, south, west
-    markPosition(startX, startY, ' ');
+/**
+ * A cell found by expanding a droid: a wall (no program), or a floor / oxygen cell
+ * with the droid's program that moved there.
+ */
+class FoundCell
+{
+public:
+    int x = 0;
+    int y = 0;
+    char object = -1;
+    Program *program = nullptr;
+};
 
-    for (int i = 0; i < dirs.size(); i++)
+/**
+ * Tries all unvisited directions from the droid's cell, each on a fork of the droid's program.
+ * A droid that hits a wall does not move, so its fork is re-used for the next direction.
+ *
+ * Only reads the coords map, so droids can be expanded in parallel.
+ */
+void expandDroid(const Droid &droid, vector<FoundCell> &found)
+{
+    vector<int> dirs{1, 4, 2, 3}; // north, east, south, west
+    Program *spare = nullptr;
+    for (int dir : dirs)
     {
-        int dir = dirs[i];
-        startX = origX;
-        startY = origY;
-
-        // Try to walk in a direction:
-        switch (dir)
-        {
-        case 1:
-            startY--;
-            break;
-        case 2:
-            startY++;
-            break;
-        case 3:
-            startX--;
-            break;
-        case 4:
-            startX++;
-            break;
-        }
-
-        // Check if we have visited the next position already: If so, do not consider
-        // it anymore, continue in the next direction:
-        if (!checkPosition(startX, startY))
+        int x = droid.x + (dir == 3 ? -1 : dir == 4 ? 1 : 0);
+        int y = droid.y + (dir == 1 ? -1 : dir == 2 ? 1 : 0);
+        if (!checkPosition(x, y))
         {
             continue;
         }
-
-        // Move the robot in the actual direction:
+        Program *p = spare != nullptr ? spare : new Program(*droid.program);
+        spare = nullptr;
         p->inputValues.push(cpp_int(dir));
         p->runProgram();
-        cpp_int output = p->output;
-
-        // Hit a wall: continue to other direction
-        if (output == 0)
+        if (p->output == 0)
         {
-            markPosition(startX, startY, '#');
-            continue;
+            found.push_back({x, y, '#', nullptr});
+            spare = p;
         }
-
-        // Found oxygen system: Output movement counter, as this is solution 1,
-        // but continue mapping, as the whole map is needed for solutoin 2:
-        if (output == 2)
+        else
         {
-            markPosition(startX, startY, 'O');
-            moveCounter++;
-            cout << "Solution 1: Oxygen system found after " << moveCounter << " steps" << endl;
-            return output;
+            found.push_back({x, y, p->output == 2 ? 'O' : ' ', p});
         }
+    }
+    delete spare;
+}
 
-        // The robot is moved to an empty, unvisited floor:
-        if (output == 1)
-        {
-            // Look forward by recursively start the walk() method again:
-            // It can only respond with 0 (hit wall somewhere beyond)
-            // or 2 (found oxygen source). In any case, step back to where the robot came,
-            // to map the other directions.
-            cpp_int result{0};
-            result = walk(p, startX, startY, moveCounter + 1);
-
-            // we walked, but hit a wall. Not good. Go back.
-            if (result == 0)
+/**
+ * The workhorse for Solution 1: Maps the whole maze with a BFS.
+ *
+ * Each frontier cell has its own droid (forked program), so no droid ever has to walk back.
+ * The frontier of each step is expanded in parallel, the found cells are then merged into the coords map.
+ * As it is a BFS, the step in which the oxygen system is found is the shortest way to it.
+ *
+ * Returns the nr of steps to the oxygen system, or -1 if there is none.
+ */
+int exploreMaze(const memory_t &data)
+{
+    markPosition(0, 0, ' ');
+    vector<Droid> frontier{{0, 0, new Program(&data)}};
+    unsigned int nrOfWorkers = max(1u, thread::hardware_concurrency());
+    int steps = 0;
+    int oxygenSteps = -1;
+
+    while (frontier.size() > 0)
+    {
+        steps++;
+        vector<vector<FoundCell>> found(frontier.size());
+        atomic<unsigned long> nextIndex{0};
+        auto expand = [&]() {
+            for (unsigned long i = nextIndex++; i < frontier.size(); i = nextIndex++)
             {
-                p->inputValues.push(cpp_int(dirs[(i + 2) % 4]));
-                p->runProgram();
-                continue;
+                expandDroid(frontier[i], found[i]);
+                delete frontier[i].program;
             }
+        };
+        vector<thread> workers;
+        for (unsigned int w = 1; w < min<unsigned long>(nrOfWorkers, frontier.size()); w++)
+        {
+            workers.push_back(thread(expand));
+        }
+        expand();
+        for (auto &t : workers)
+        {
+            t.join();
+        }
 
-            // good, found the oxygen system somewhere ahead. Move on, to map the location
-            if (result == 2)
+        // Merge: Two droids may have found the same cell, keep the first one
+        vector<Droid> next;
+        for (auto &cells : found)
+        {
+            for (auto &cell : cells)
             {
-                p->inputValues.push(cpp_int(dirs[(i + 2) % 4]));
-                p->runProgram();
-                continue;
+                if (!markPosition(cell.x, cell.y, cell.object))
+                {
+                    delete cell.program;
+                    continue;
+                }
+                if (cell.object == 'O' && oxygenSteps < 0)
+                {
+                    oxygenSteps = steps;
+                }
+                if (cell.program != nullptr)
+                {
+                    next.push_back({cell.x, cell.y, cell.program});
+                }
             }
         }
+        frontier = next;
     }
-    // If we reach this far, we could not found any direction to walk to...
-    // We return with 'wall hit', as this is a dead end.
-    return cpp_int(0);
+    return oxygenSteps;
 }
 
 /**
- * The backtrack function walk() has built a coordinate map
+ * The BFS exploreMaze() has built a coordinate map
  * with relative (to the start, which is 0/0) coordinates and unknown map size.
  * Here we built a Y x X vector with normalized coordinates: Each entry contains
  * a Point with its normalized coordinates and what it contains:
@@ -185,8 +215,8 @@ cpp_int walk(Program *p, int startX, int startY, int moveCounter)
 Point *buildFloorMap()
 {
     int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
-    Point *oxygenPos;
-    for (map<string, Point *>::iterator it = coords.begin(); it != coords.end(); ++it)
+    Point *oxygenPos = nullptr;
+    for (unordered_map<long, Point *>::iterator it = coords.begin(); it != coords.end(); ++it)
     {
         Point *p = it->second;
         if (minX > p->x)
@@ -212,7 +242,7 @@ Point *buildFloorMap()
 
         for (int x = minX; x <= maxX; ++x)
         {
-            string key = to_string(x) + ":" + to_string(y);
+            long key = pointKey(x, y);
             Point *p;
             if (coords.count(key) > 0)
             {
@@ -234,6 +264,11 @@ Point *buildFloorMap()
         }
         floorMap.push_back(line);
     }
+    if (oxygenPos == nullptr)
+    {
+        cerr << "Error: no oxygen system found on the map" << endl;
+        exit(1);
+    }
     return oxygenPos;
 }
 
@@ -274,108 +309,256 @@ void printMap()
  */
 void solution1(memory_t &data)
 {
-    Program program(&data);
-    map<string, vector<cpp_int>> paintArea;
-    vector<cpp_int> values;
-    cpp_int actInput;
-    while (program.state != P_HALT)
+    int steps = exploreMaze(data);
+    if (steps < 0)
     {
-        walk(&program, 0, 0, 0);
-        break;
+        cerr << "Error: No oxygen system found" << endl;
+        exit(1);
     }
+    cout << "Solution 1: Oxygen system found after " << steps << " steps" << endl;
 }
 
 
 /**
- * Starts solution 2
+ * A map of bits, packed into 64-bit words per row: bit x of a row is in word x / 64, bit x % 64.
+ */
+class BitMap
+{
+public:
+    int width;
+    int height;
+    int wordsPerRow;
+    vector<uint64_t> words;
+
+    BitMap(int width, int height) : width{width}, height{height}, wordsPerRow{(width + 63) / 64}
+    {
+        words.resize(static_cast<size_t>(height) * wordsPerRow, 0);
+    }
+
+    uint64_t *row(int y)
+    {
+        return &words[static_cast<size_t>(y) * wordsPerRow];
+    }
+
+    const uint64_t *row(int y) const
+    {
+        return &words[static_cast<size_t>(y) * wordsPerRow];
+    }
+
+    void set(int x, int y)
+    {
+        row(y)[x / 64] |= uint64_t(1) << (x % 64);
+    }
+
+    bool get(int x, int y) const
+    {
+        return (row(y)[x / 64] >> (x % 64)) & 1;
+    }
+};
+
+/**
+ * Spreads the oxygen by one minute: Each oxygen bit spreads to its 4 neighbours, as far as they are open.
+ * Done word-parallel: left / right neighbours by shifting the row (with the carry bit from the neighbour word),
+ * up / down neighbours are the rows above / below.
  *
- * Idea: Use a processing queue to process each inserted oxygen (and then its "childs"), until no more
- * oxygen needs to be produced.
+ * Only the given rows are calculated: a row can only change if it or one of its neighbour rows
+ * changed in the minute before. The new rows are collected in scratch first, so the spread
+ * sees the oxygen of the last minute only.
  *
- * Start with the oxygen point. Create new oxygen in all 4 directions, until a wall is reached.
- * Register each new oxygen point in a "to process" list.
- * Now, process the "to process" list, do the same for each oxygen point, and register new oxygen.
- * Repeat until no more oxygen is in the process list.
+ * Returns the rows that got new oxygen.
  */
-void solution2(Point *oStart, bool display)
+vector<int> floodStep(const BitMap &open, BitMap &oxygen, const vector<int> &rows, vector<uint64_t> &scratch)
 {
-    vector<Point *> processList;
-    vector<Point *> nextToProcess;
-    processList.push_back(oStart);
-    int counter = 0;
-    Point *act;
-    while (processList.size() > 0)
+    int n = oxygen.wordsPerRow;
+    scratch.resize(rows.size() * n);
+    vector<int> changedRows;
+    for (size_t i = 0; i < rows.size(); i++)
     {
-        nextToProcess.clear();
-        for (auto oxy : processList)
+        int y = rows[i];
+        const uint64_t *act = oxygen.row(y);
+        const uint64_t *up = y > 0 ? oxygen.row(y - 1) : nullptr;
+        const uint64_t *down = y < oxygen.height - 1 ? oxygen.row(y + 1) : nullptr;
+        const uint64_t *mask = open.row(y);
+        uint64_t *out = &scratch[i * n];
+        bool changed = false;
+        for (int w = 0; w < n; w++)
         {
-            // Check all 4 directions for an empty space:
-            act = nullptr;
-            // Up:
-            if (oxy->y > 0)
+            uint64_t spread = act[w];
+            spread |= (act[w] << 1) | (w > 0 ? act[w - 1] >> 63 : 0);
+            spread |= (act[w] >> 1) | (w < n - 1 ? act[w + 1] << 63 : 0);
+            if (up != nullptr)
             {
-                act = floorMap[oxy->y - 1][oxy->x];
-                if (act->object == ' ')
-                {
-                    act->object = 'O';
-                    nextToProcess.push_back(act);
-                }
+                spread |= up[w];
             }
-            // right:
-            if (oxy->x < floorMap[0].size())
+            if (down != nullptr)
             {
-                act = floorMap[oxy->y][oxy->x + 1];
-                if (act->object == ' ')
-                {
-                    act->object = 'O';
-                    nextToProcess.push_back(act);
-                }
+                spread |= down[w];
             }
-            // down:
-            if (oxy->y < floorMap.size())
+            spread &= mask[w];
+            changed |= spread != act[w];
+            out[w] = spread;
+        }
+        if (changed)
+        {
+            changedRows.push_back(i);
+        }
+    }
+    for (auto &i : changedRows)
+    {
+        copy(&scratch[i * n], &scratch[i * n] + n, oxygen.row(rows[i]));
+        i = rows[i];
+    }
+    return changedRows;
+}
+
+/**
+ * Floods the open cells from the oxygen start until nothing changes anymore.
+ * Returns the nr of minutes it took. The optional onStep callback is called with the
+ * oxygen map after each minute.
+ */
+int floodFill(const BitMap &open, BitMap &oxygen, function<void(const BitMap &)> onStep = nullptr)
+{
+    vector<uint64_t> scratch;
+    vector<int> rows;
+    for (int y = 0; y < oxygen.height; y++)
+    {
+        rows.push_back(y);
+    }
+    // Marks if a row is already in the next rows list:
+    vector<int> rowMinute(oxygen.height, -1);
+    int minutes = 0;
+    while (true)
+    {
+        vector<int> changed = floodStep(open, oxygen, rows, scratch);
+        if (changed.size() == 0)
+        {
+            break;
+        }
+        minutes++;
+        if (onStep)
+        {
+            onStep(oxygen);
+        }
+        rows.clear();
+        for (int y : changed)
+        {
+            for (int r = max(0, y - 1); r <= min(oxygen.height - 1, y + 1); r++)
             {
-                act = floorMap[oxy->y + 1][oxy->x];
-                if (act->object == ' ')
+                if (rowMinute[r] != minutes)
                 {
-                    act->object = 'O';
-                    nextToProcess.push_back(act);
+                    rowMinute[r] = minutes;
+                    rows.push_back(r);
                 }
             }
-            // left
-            if (oxy->x > 0)
+        }
+    }
+    return minutes;
+}
+
+/**
+ * Starts solution 2
+ *
+ * The floor map is packed into bit maps (open cells, cells with oxygen), then flooded
+ * from the oxygen system with word-parallel steps (see floodFill), until no more oxygen spreads.
+ */
+void solution2(Point *oStart, bool display)
+{
+    int height = floorMap.size();
+    int width = floorMap[0].size();
+    BitMap open(width, height);
+    BitMap oxygen(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (floorMap[y][x]->object != '#')
+            {
+                open.set(x, y);
+            }
+        }
+    }
+    oxygen.set(oStart->x, oStart->y);
+
+    function<void(const BitMap &)> onStep = nullptr;
+    if (display)
+    {
+        onStep = [](const BitMap &oxygen) {
+            for (int y = 0; y < oxygen.height; y++)
             {
-                act = floorMap[oxy->y][oxy->x - 1];
-                if (act->object == ' ')
+                for (int x = 0; x < oxygen.width; x++)
                 {
-                    act->object = 'O';
-                    nextToProcess.push_back(act);
+                    if (oxygen.get(x, y))
+                    {
+                        floorMap[y][x]->object = 'O';
+                    }
                 }
             }
-        }
-        if (display)
-        {
             printMap();
             std::chrono::milliseconds timespan(30);
             std::this_thread::sleep_for(timespan);
-        }
-        counter++;
-        processList.clear();
-        processList = nextToProcess;
+        };
     }
-    counter--; // one too much, last does not count
-    if (display)
+    int counter = floodFill(open, oxygen, onStep);
+    cout << "Solution 2: Room filled after " << counter << " Minutes" << endl;
+}
+
+/**
+ * Floods a generated maze of size x size cells, to see how the flood fill scales.
+ *
+ * The maze is a random spanning tree over the odd cells (iterative backtracker), so it has
+ * long corridors, like the droid's maze. The oxygen starts in the top-left corner.
+ */
+void floodBenchmark(int size)
+{
+    size = size | 1;
+    BitMap open(size, size);
+    mt19937 random(15);
+    vector<pair<int, int>> stack{{1, 1}};
+    open.set(1, 1);
+    while (stack.size() > 0)
     {
-        printMap();
+        auto act = stack.back();
+        vector<pair<int, int>> dirs;
+        for (auto d : vector<pair<int, int>>{{0, -2}, {2, 0}, {0, 2}, {-2, 0}})
+        {
+            int x = act.first + d.first;
+            int y = act.second + d.second;
+            if (x > 0 && y > 0 && x < size - 1 && y < size - 1 && !open.get(x, y))
+            {
+                dirs.push_back(d);
+            }
+        }
+        if (dirs.size() == 0)
+        {
+            stack.pop_back();
+            continue;
+        }
+        auto d = dirs[random() % dirs.size()];
+        open.set(act.first + d.first / 2, act.second + d.second / 2);
+        open.set(act.first + d.first, act.second + d.second);
+        stack.push_back({act.first + d.first, act.second + d.second});
     }
-    cout << "Solution 2: Room filled after " << counter << " Minutes" << endl;
+
+    BitMap oxygen(size, size);
+    oxygen.set(1, 1);
+    auto start = chrono::steady_clock::now();
+    int minutes = floodFill(open, oxygen);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Generated " << size << " x " << size << " maze filled after " << minutes << " Minutes, in " << ms << " ms" << endl;
 }
 
 int main(int argc, char *args[])
 {
     bool display = argc >= 3 && string("--display").compare(args[2]) == 0 ? true : false;
+    if (argc >= 3 && string("--flood-benchmark").compare(args[1]) == 0)
+    {
+        floodBenchmark(stoi(args[2]));
+        return 0;
+    }
     if (argc < 2)
     {
         cerr << "Error: give input file on command line" << endl;
+        cerr << "    or: --flood-benchmark <maze size> to flood a generated maze" << endl;
         exit(1);
     }
 
@@ -3,6 +3,9 @@
 #include <vector>
 #include <map>
 #include <queue>
+#include <set>
+#include <array>
+#include <cstdint>
 #include "common.h"
 #include "intcode.h"
 #include <boost/multiprecision/cpp_int.hpp>
@@ -13,25 +16,81 @@ using namespace std;
 using namespace boost::multiprecision;
 using namespace boost;
 
-class Point {
+/**
+ * The scaffold as a bitboard: one bit per cell, packed into 64-bit words per row
+ * (cell x of a row is bit x % 64 of word x / 64).
+ */
+class Bitboard {
     public:
-        Coord coord{0,0};
-        char value = 0;
-        bool visited = false;
+        int width = 0;
+        int height = 0;
+        int wordsPerRow = 0;
+        vector<uint64_t> words;
+
+        void resize(int w, int h) {
+            width = w;
+            height = h;
+            wordsPerRow = (w + 63) / 64;
+            words.assign(static_cast<size_t>(h) * wordsPerRow, 0);
+        }
 
-        Point(int x, int y, char v): value{v} {
-            coord = Coord(x, y);
+        const uint64_t *row(int y) const {
+            return &words[static_cast<size_t>(y) * wordsPerRow];
         }
-        Point() {
 
+        void set(int x, int y) {
+            words[static_cast<size_t>(y) * wordsPerRow + x / 64] |= uint64_t(1) << (x % 64);
+        }
+
+        /**
+         * Is the cell a scaffold? Cells outside the board are not.
+         */
+        bool get(int x, int y) const {
+            if (x < 0 || y < 0 || x >= width || y >= height) {
+                return false;
+            }
+            return (row(y)[x / 64] >> (x % 64)) & 1;
+        }
+
+        /**
+         * Nr of scaffold cells in a row, starting next to x, in direction right (dir 1) or left (dir 3):
+         * found by a bit-scan for the first non-scaffold bit.
+         */
+        int horizontalRun(int x, int y, int dir) const {
+            const uint64_t *r = row(y);
+            int run = 0;
+            if (dir == 1) {
+                for (int pos = x + 1; pos < width;) {
+                    int bit = pos % 64;
+                    uint64_t gaps = ~r[pos / 64] >> bit;
+                    int len = gaps == 0 ? 64 - bit : __builtin_ctzll(gaps);
+                    run += len;
+                    if (len < 64 - bit) {
+                        break;
+                    }
+                    pos += len;
+                }
+            } else {
+                for (int pos = x - 1; pos >= 0;) {
+                    int bit = pos % 64;
+                    uint64_t gaps = ~r[pos / 64] << (63 - bit);
+                    int len = gaps == 0 ? bit + 1 : __builtin_clzll(gaps);
+                    run += len;
+                    if (len < bit + 1) {
+                        break;
+                    }
+                    pos -= len;
+                }
+            }
+            return run;
         }
 };
 
-typedef vector<Point> map_line_t;
-typedef vector<map_line_t> map_t;
-map_t scaffoldMap;
-vector<Point> intersections;
-Point robot;
+vector<string> mapLines;
+Bitboard scaffold;
+int nrOfIntersections = 0;
+Coord robotPos;
+int robotDir = 0; // 0 = up, 1 = right, 2 = down, 3 = left
 
 /**
  * Day 17 - Set and Forget
@@ -43,47 +102,61 @@ Point robot;
  */
 void printMap()
 {
-    for (auto l : scaffoldMap) {
-        for (auto c : l) {
-            cout << c.value;
+    for (auto &l : mapLines) {
+        cout << l << endl;
+    }
+}
+
+/**
+ * Builds the scaffold bitboard from the map lines, and finds the robot
+ */
+void buildScaffold()
+{
+    int width = 0;
+    for (auto &l : mapLines) {
+        width = max(width, static_cast<int>(l.size()));
+    }
+    scaffold.resize(width, mapLines.size());
+    for (vector<string>::size_type y = 0; y < mapLines.size(); ++y) {
+        for (string::size_type x = 0; x < mapLines[y].size(); ++x) {
+            char value = mapLines[y][x];
+            if (value == '#') {
+                scaffold.set(x, y);
+            } else if (value == '^' || value == '<' || value == '>' || value =='v') {
+                robotPos = Coord(x, y);
+                robotDir = value == '^' ? 0 : (value == '>' ? 1 : (value == 'v' ? 2 : 3));
+            }
         }
-        cout << endl;
     }
 }
 
 /**
- * Marks and collects intersections and the robot
+ * Finds the intersections, word-parallel on the bitboard: A scaffold is an intersection if
+ * its left, right, upper and lower neighbours are scaffolds, too, so for each row:
+ * row & (row << 1) & (row >> 1) & above & below (with the carry bits from the neighbour words).
+ *
+ * Returns the sum of the alignment parameters (x * y) of all intersections.
  */
-int analyzeMap(map_t &theMap)
+int analyzeMap(const Bitboard &board)
 {
     int sum = 0;
-    // theMap[theMap.size()-1][theMap[theMap.size()-1].size()-1];
-    cout << "max X:" << theMap[0].size()-1 << ", max Y: " << theMap.size()-1 << endl;
-    for (map_t::size_type y = 0; y < theMap.size(); ++y) {
-        for (map_t::size_type x = 0; x < theMap[y].size(); ++x) {
-            // cout << "X:" << x << ", Y: " << y << endl;
-            char value = theMap[y][x].value;
-            if (value == 35) // '#
-            {
-                //look in all 4 dirs if there is also a '#': then it is an intersection
-                if (y > 0 && x > 0 && y < theMap.size()-1 && x < theMap[y].size()-1)
-                {
-                    //    cout << "X:" << x << ", Y: " << y << endl;
-                    if ( theMap[y-1][x].value == 35 &&
-                            theMap[y+1][x].value == 35 &&
-                            theMap[y][x-1].value == 35 &&
-                            theMap[y][x+1].value == 35
-                       ) {
-                        //    theMap[y][x].value = 'O';
-                        sum += y*x;
-                        intersections.push_back(theMap[y][x]);
-                    }
-                }
-            } else if (value == '^' || value == '<' || value == '>' || value =='v') {
-                robot = theMap[y][x];
-                robot.value = value == '^' ? 0 : (value == '>' ? 1 : (value == 'v' ? 2 : 3));
+    int n = board.wordsPerRow;
+    for (int y = 1; y < board.height - 1; ++y) {
+        const uint64_t *r = board.row(y);
+        const uint64_t *above = board.row(y - 1);
+        const uint64_t *below = board.row(y + 1);
+        int sumX = 0;
+        for (int w = 0; w < n; w++) {
+            uint64_t leftSet = (r[w] << 1) | (w > 0 ? r[w - 1] >> 63 : 0);
+            uint64_t rightSet = (r[w] >> 1) | (w < n - 1 ? r[w + 1] << 63 : 0);
+            uint64_t crossings = r[w] & leftSet & rightSet & above[w] & below[w];
+            nrOfIntersections += __builtin_popcountll(crossings);
+            while (crossings != 0) {
+                sumX += w * 64 + __builtin_ctzll(crossings);
+                crossings &= crossings - 1;
             }
         }
+        sum += sumX * y;
     }
     return sum;
 }
@@ -94,163 +167,378 @@ int analyzeMap(map_t &theMap)
  */
 void solution1(memory_t &data)
 {
-    Program program(&data);
-    map_line_t line;
-    int x = 0; int y = 0;
+    AsciiProgram program(&data);
+    program.sink.onLine = [&](string_view line) {
+        if (!line.empty()) {
+            mapLines.emplace_back(line);
+        }
+    };
     while (program.state != P_HALT) {
         program.runProgram();
-        char output = static_cast<char>(program.output);
-        if (output != 10) {
-            Point p(x, y, output);
-            line.push_back(p);
-            x++;
-        } else {
-            if (x > 0) {
-                scaffoldMap.push_back(line);
-                y++;
-                x = 0;
-                line = map_line_t();
-            }
+        if (program.state == P_INPUT) {
+            cerr << "Error: the camera program waits for input" << endl;
+            exit(1);
         }
     }
-    int sumOfIntersections = analyzeMap(scaffoldMap);
+    buildScaffold();
+    cout << "max X:" << scaffold.width - 1 << ", max Y: " << scaffold.height - 1 << endl;
+    int sumOfIntersections = analyzeMap(scaffold);
     printMap();
-    cout << "Nr of intersections: " << intersections.size() << endl;
-    cout << "Robot position: " << robot.coord.x << ":" << robot.coord.y << endl;
+    cout << "Nr of intersections: " << nrOfIntersections << endl;
+    cout << "Robot position: " << robotPos.x << ":" << robotPos.y << endl;
     cout << "Solution 1: Intersections product sum: " << sumOfIntersections << endl;
 }
 
 
+/**
+ * The movement routine: the main routine (a list of function indices, 0 = A, 1 = B, 2 = C),
+ * and the movement functions, each as a range of path elements (start element, nr of elements).
+ */
+class MovementRoutine {
+    public:
+        vector<int> mainRoutine;
+        vector<pair<int, int>> functions;
+};
+
+/**
+ * Splits a path (e.g. "L,10,R,12,...") into a main routine and max. 3 movement functions,
+ * each max. 20 chars long.
+ *
+ * A path element is a turn plus the steps ("L,10"). This is a depth-first search over the path offset:
+ * At each offset, either a known function must match the path (prefix match), or a new function
+ * starts here. Failed search states (offset + nr of calls + functions) are memoised, so they are never searched twice.
+ */
+class PathCompressor {
+    public:
+        static const int MAX_CHARS = 20;
+        static const int MAX_FUNCTIONS = 3;
+
+        PathCompressor(const string &path) {
+            vector<string> parts;
+            split(path, ',', parts);
+            map<string, int> ids;
+            for (vector<string>::size_type i = 0; i + 1 < parts.size(); i += 2) {
+                string element = parts[i] + "," + parts[i + 1];
+                if (ids.count(element) == 0) {
+                    ids[element] = ids.size();
+                }
+                elements.push_back(element);
+                elementIds.push_back(ids[element]);
+            }
+        }
+
+        bool compress(MovementRoutine &routine) {
+            routine.mainRoutine.clear();
+            routine.functions.clear();
+            return search(0, routine);
+        }
+
+        string mainRoutineString(const MovementRoutine &routine) const {
+            string str;
+            for (auto f : routine.mainRoutine) {
+                str += string(str.empty() ? "" : ",") + char('A' + f);
+            }
+            return str;
+        }
+
+        string functionString(const MovementRoutine &routine, int f) const {
+            string str;
+            if (f < static_cast<int>(routine.functions.size())) {
+                for (int i = 0; i < routine.functions[f].second; i++) {
+                    str += (i > 0 ? "," : "") + elements[routine.functions[f].first + i];
+                }
+            }
+            return str;
+        }
+
+    private:
+        vector<string> elements;
+        vector<int> elementIds;
+        set<std::array<int, 8>> failed;
+
+        bool matches(const pair<int, int> &function, int offset) const {
+            if (offset + function.second > static_cast<int>(elementIds.size())) {
+                return false;
+            }
+            for (int i = 0; i < function.second; i++) {
+                if (elementIds[function.first + i] != elementIds[offset + i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool search(int offset, MovementRoutine &routine) {
+            if (offset == static_cast<int>(elementIds.size())) {
+                return true;
+            }
+            // "A,B,C": max. 10 calls in 20 chars
+            if (static_cast<int>(routine.mainRoutine.size()) >= (MAX_CHARS + 1) / 2) {
+                return false;
+            }
+            // The nr of calls so far is part of the state: with more calls, the call limit fails earlier
+            std::array<int, 8> state{offset, static_cast<int>(routine.mainRoutine.size()), -1, -1, -1, -1, -1, -1};
+            for (vector<pair<int, int>>::size_type f = 0; f < routine.functions.size(); f++) {
+                state[2 + 2 * f] = routine.functions[f].first;
+                state[3 + 2 * f] = routine.functions[f].second;
+            }
+            if (failed.count(state) > 0) {
+                return false;
+            }
+
+            // Use a known function:
+            for (vector<pair<int, int>>::size_type f = 0; f < routine.functions.size(); f++) {
+                if (matches(routine.functions[f], offset)) {
+                    routine.mainRoutine.push_back(f);
+                    if (search(offset + routine.functions[f].second, routine)) {
+                        return true;
+                    }
+                    routine.mainRoutine.pop_back();
+                }
+            }
+            // Start a new function here, as long as possible first:
+            if (static_cast<int>(routine.functions.size()) < MAX_FUNCTIONS) {
+                int maxLength = 0;
+                int chars = -1;
+                while (offset + maxLength < static_cast<int>(elements.size()) &&
+                       chars + 1 + static_cast<int>(elements[offset + maxLength].size()) <= MAX_CHARS) {
+                    chars += 1 + elements[offset + maxLength].size();
+                    maxLength++;
+                }
+                for (int length = maxLength; length > 0; length--) {
+                    routine.functions.push_back({offset, length});
+                    routine.mainRoutine.push_back(routine.functions.size() - 1);
+                    if (search(offset + length, routine)) {
+                        return true;
+                    }
+                    routine.mainRoutine.pop_back();
+                    routine.functions.pop_back();
+                }
+            }
+            failed.insert(state);
+            return false;
+        }
+};
+
+/**
+ * Renders the robot's continuous video feed: Each camera frame is compared to the last one, and only
+ * the changed chars are drawn (ANSI cursor positioning). The frame buffer of the sink and the last
+ * frame are re-used, so no frame allocates. Other "frames" (e.g. the prompts) are skipped.
+ *
+ * The decode time of a frame is the time the program needed to produce it, since the last frame.
+ */
+class VideoFeed {
+    public:
+        VideoFeed(size_t height): height{height} {
+            lastFrame.resize(height);
+        }
+
+        void start() {
+            // clear screen, hide cursor:
+            cout << "\033[2J\033[?25l" << flush;
+            lastFrameEnd = chrono::steady_clock::now();
+        }
+
+        void onFrame(const vector<string> &frame, size_t rows) {
+            auto decoded = chrono::steady_clock::now();
+            double decodeMicros = chrono::duration<double, micro>(decoded - lastFrameEnd).count();
+            if (rows != height) {
+                skipped++;
+                lastFrameEnd = decoded;
+                return;
+            }
+            out.clear();
+            for (size_t y = 0; y < rows; y++) {
+                const string &row = frame[y];
+                string &last = lastFrame[y];
+                size_t x = 0;
+                while (x < row.size()) {
+                    if (x < last.size() && last[x] == row[x]) {
+                        x++;
+                        continue;
+                    }
+                    // A run of changed chars: position the cursor once
+                    out += "\033[" + to_string(y + 1) + ";" + to_string(x + 1) + "H";
+                    while (x < row.size() && (x >= last.size() || last[x] != row[x])) {
+                        out += row[x];
+                        x++;
+                    }
+                }
+                last.assign(row);
+            }
+            frames++;
+            out += "\033[" + to_string(height + 1) + ";1HFrame " + to_string(frames) + ", decoded in " +
+                   to_string(static_cast<long>(decodeMicros)) + " µs\033[K";
+            cout << out << flush;
+            bytesWritten += out.size();
+            totalDecodeMicros += decodeMicros;
+            maxDecodeMicros = max(maxDecodeMicros, decodeMicros);
+            lastFrameEnd = chrono::steady_clock::now();
+            totalRenderMicros += chrono::duration<double, micro>(lastFrameEnd - decoded).count();
+        }
+
+        void finish() {
+            // show cursor again, move below the feed:
+            cout << "\033[" << height + 2 << ";1H\033[?25h";
+            cout << "Video feed: " << frames << " frames (" << skipped << " skipped), decode avg "
+                 << static_cast<long>(frames > 0 ? totalDecodeMicros / frames : 0) << " µs / max "
+                 << static_cast<long>(maxDecodeMicros) << " µs, render avg "
+                 << static_cast<long>(frames > 0 ? totalRenderMicros / frames : 0) << " µs, "
+                 << bytesWritten << " bytes written" << endl;
+        }
+
+    private:
+        size_t height;
+        vector<string> lastFrame;
+        string out;
+        chrono::steady_clock::time_point lastFrameEnd;
+        unsigned long frames = 0;
+        unsigned long skipped = 0;
+        unsigned long bytesWritten = 0;
+        double totalDecodeMicros = 0;
+        double maxDecodeMicros = 0;
+        double totalRenderMicros = 0;
+};
+
 /**
  * Starts solution 2
+ *
+ * With video, the robot's continuous video feed is rendered while it moves.
  */
-void solution2(memory_t &data)
+void solution2(memory_t &data, bool video)
 {
     // Start robot:
     data[0] = cpp_int(2);
-    Program program(&data);
+    AsciiProgram program(&data);
     string commands;
     // First, build a list of all movement functions, which will be split into smaller ones and
     // called by the main movement routine.
-
-    int actWalkDir = robot.value; // 0 = up, 1 = right, 2 = down, 3 = left
-    int moveCounter = 0;
-
+    //
+    // Trace the path on the bitboard: walk straight to the end of each segment (crossing
+    // intersections), then turn left or right - the only ways the scaffold can go on.
+    int x = robotPos.x;
+    int y = robotPos.y;
+    int dir = robotDir;
+    const int dx[] = {0, 1, 0, -1};
+    const int dy[] = {-1, 0, 1, 0};
     while (true) {
-        int dir = robot.value;
-        int x = robot.coord.x;
-        int y = robot.coord.y;
-        // Mark the position where the robot sits as visited:
-        scaffoldMap[y][x].visited = true;
-
-        // let the robot walk in the actual direction, if possible:
-        // find the dir in which to let the robot run:
-        if (dir == 0 && y > 0 && scaffoldMap[y-1][x].value == '#')
-        {
-            moveCounter++;
-            robot.coord.y--;
-        } else if (dir == 1 && x < scaffoldMap[y].size()-1 && scaffoldMap[y][x+1].value == '#')
-        {
-            moveCounter++;
-            robot.coord.x++;
-        } else if (dir == 2 && y < scaffoldMap.size()-1 && scaffoldMap[y+1][x].value == '#')
-        {
-            moveCounter++;
-            robot.coord.y++;
-        } else if (dir == 3 && x > 0 && scaffoldMap[y][x-1].value == '#')
-        {
-            moveCounter++;
-            robot.coord.x--;
+        int right = (dir + 1) % 4;
+        int left = (dir + 3) % 4;
+        if (scaffold.get(x + dx[right], y + dy[right])) {
+            commands += string(commands.empty() ? "" : ",") + "R,";
+            dir = right;
+        } else if (scaffold.get(x + dx[left], y + dy[left])) {
+            commands += string(commands.empty() ? "" : ",") + "L,";
+            dir = left;
         } else {
-            // Moving forward not possible, try to turn:
-            // find the dir in which to let the robot run:
-            actWalkDir = -1; // no direction
-            if (y > 0 && scaffoldMap[y-1][x].value == '#' && scaffoldMap[y-1][x].visited == false)
-            {
-                actWalkDir = 0;
-            } else if (x < scaffoldMap[y].size()-1 && scaffoldMap[y][x+1].value == '#' && scaffoldMap[y][x+1].visited == false)
-            {
-                actWalkDir = 1;
-            } else if (y < scaffoldMap.size()-1 && scaffoldMap[y+1][x].value == '#' && scaffoldMap[y+1][x].visited == false)
-            {
-                actWalkDir = 2;
-            } else if (x > 0 && scaffoldMap[y][x-1].value == '#' && scaffoldMap[y][x-1].visited == false)
-            {
-                actWalkDir = 3;
-            }
-            if (actWalkDir == -1) {
-                // No more directions to walk. End.
-                cout << "Reached final destination" << endl;
-                break;
-            }
-
-            // Turn the robot, if necessary:
-            if (actWalkDir != dir) {
-                if (moveCounter > 0) {
-                    commands += to_string(moveCounter) + ",";
-                    moveCounter = 0;
-                }
-                int targetSourceDiff = actWalkDir - dir;
-                if (targetSourceDiff == 1 || targetSourceDiff == -3) {
-                    // Turn robot dir -> walkDir to right:
-                    commands += "R,";
-                } else if (targetSourceDiff == -1 || targetSourceDiff == 3)
-                {
-                    // Turn robot dir -> walkDir to left:
-                    commands += "L,";
-                }
+            // No more directions to walk. End.
+            cout << "Reached final destination" << endl;
+            break;
+        }
+        int steps = 0;
+        if (dir == 1 || dir == 3) {
+            steps = scaffold.horizontalRun(x, y, dir);
+        } else {
+            while (scaffold.get(x, y + dy[dir] * (steps + 1))) {
+                steps++;
             }
-            robot.value = actWalkDir;
         }
-    }
-    if (moveCounter > 0) {
-        commands += to_string(moveCounter);
+        x += dx[dir] * steps;
+        y += dy[dir] * steps;
+        commands += to_string(steps);
     }
     cout << commands << endl;
-    /**
-     * Do splitting the output with pen-and-paper:
-     * A: L,10,R,12,R,12,
-     * B: R,6,R,10,L,10,
-     * A: L,10,R,12,R,12,
-     * C: R,10,L,10,L,12,R,6,
-     * B: R,6,R,10,L,10,
-     * C: R,10,L,10,L,12,R,6,
-     * B: R,6,R,10,L,10,
-     * C: R,10,L,10,L,12,R,6,
-     * A: L,10,R,12,R,12,
-     * C: R,10,L,10,L,12,R,6
-     *
-     * -->
-     * Main movement:
-     * A,B,A,C,B,C,B,C,A,C (19)
-     * A: L,10,R,12,R,12
-     * B: R,6,R,10,L,10
-     * C: R,10,L,10,L,12,R,6
-     */
-    string main_command = "A,B,A,C,B,C,B,C,A,C";
-    string function_a = "L,10,R,12,R,12";
-    string function_b = "R,6,R,10,L,10";
-    string function_c = "R,10,L,10,L,12,R,6";
+
+    // Split the path into the movement functions:
+    auto start = chrono::steady_clock::now();
+    PathCompressor compressor(commands);
+    MovementRoutine routine;
+    if (!compressor.compress(routine)) {
+        cerr << "Error: the path cannot be split into 3 movement functions" << endl;
+        exit(1);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    string main_command = compressor.mainRoutineString(routine);
+    string function_a = compressor.functionString(routine, 0);
+    string function_b = compressor.functionString(routine, 1);
+    string function_c = compressor.functionString(routine, 2);
+    cout << "Path compressed in " << ms << " ms:" << endl;
+    cout << "Main movement: " << main_command << endl;
+    cout << "A: " << function_a << endl;
+    cout << "B: " << function_b << endl;
+    cout << "C: " << function_c << endl;
 
     // Fill inputs:
     program.asciiInput(main_command);
     program.asciiInput(function_a);
     program.asciiInput(function_b);
     program.asciiInput(function_c);
-    // No video feed:
-    program.asciiInput("n");
+    VideoFeed feed(mapLines.size());
+    if (video) {
+        program.asciiInput("y");
+        program.sink.onFrame = [&](const vector<string> &frame, size_t rows) {
+            feed.onFrame(frame, rows);
+        };
+        feed.start();
+    } else {
+        program.asciiInput("n");
+    }
 
+    // The prompts are ASCII and collected by the sink, so the program only
+    // stops for the (non-ASCII) dust value:
     cpp_int last_output;
     while (program.state != P_HALT) {
         program.runProgram();
-        last_output = program.output;
+        if (program.state == P_OUTPUT) {
+            last_output = program.output;
+        } else if (program.state == P_INPUT) {
+            cerr << "Error: the robot asks for more input than the movement routines" << endl;
+            exit(1);
+        }
+    }
+    if (video) {
+        feed.finish();
     }
     cout << "Solution 2: Output value: " << last_output << endl;
-    cout << "**** NOTE ****: The 2nd solution is a Pen and Paper solution! It is NOT solved in a generic way." << endl;
+}
+
+/**
+ * Regression check for the path compressor: paths that can be split, but were reported as not splittable.
+ * Each found split must rebuild the path.
+ */
+bool testCompressor() {
+    vector<string> paths{
+        // main A,B,A,A,C,B,C,B,A,B - A: R,6,R,11 B: L,1,L,16,R,6 C: R,6,R,11,R,6,R,11
+        "R,6,R,11,L,1,L,16,R,6,R,6,R,11,R,6,R,11,R,6,R,11,R,6,R,11,L,1,L,16,R,6,R,6,R,11,R,6,R,11,"
+        "L,1,L,16,R,6,R,6,R,11,L,1,L,16,R,6"
+    };
+    bool ok = true;
+    for (auto &path : paths) {
+        PathCompressor compressor(path);
+        MovementRoutine routine;
+        string rebuilt;
+        if (compressor.compress(routine)) {
+            for (auto f : routine.mainRoutine) {
+                rebuilt += (rebuilt.empty() ? "" : ",") + compressor.functionString(routine, f);
+            }
+        }
+        bool passed = rebuilt == path;
+        cout << (passed ? "OK:     " : "FAILED: ") << path << endl;
+        ok = ok && passed;
+    }
+    return ok;
 }
 
 int main(int argc, char *args[])
 {
+    // --test-compressor: run the path compressor regression checks only, no input file needed
+    // (also accepted after an input file)
+    for (int i = 1; i < min(argc, 3); i++) {
+        if (string("--test-compressor").compare(args[i]) == 0) {
+            return testCompressor() ? 0 : 1;
+        }
+    }
+    // --display: show the robot's video feed in solution 2
     bool display = argc >= 3 && string("--display").compare(args[2]) == 0 ? true : false;
     if (argc < 2)
     {
@@ -263,5 +551,5 @@ int main(int argc, char *args[])
     readIntcodeProgramFromFile(args[1], data);
 
     solution1(data);
-    solution2(data);
+    solution2(data, display);
 }
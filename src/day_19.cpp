@@ -8,6 +8,9 @@
 #include <boost/multiprecision/cpp_int.hpp>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
 
 using namespace std;
 using namespace boost::multiprecision;
@@ -16,156 +19,395 @@ using namespace boost;
 /**
  * Day 19 - Tractor Beam
  *
- * This one is a bit of detective work and a bisect to find the right y position.
- * Detective work because I first had to get an idea how steep the beam is to narrow the start x for
- * each y.
+ * The beam is a cone from 0/0, so in each row it is one continuous run of cells, and both its
+ * left and right edge only move to the right from row to row. So we don't need to ask the drone
+ * for every cell: the BeamTracker follows both edges row by row, with a few drone queries per row.
  */
 
-class Point
+/**
+ * Follows the left and right beam edges row by row.
+ *
+ * For each row y, the beam covers the cells left[y] <= x < right[y] (empty row: left == right).
+ * As the edges are monotonic, a row's edges are searched starting at the edges of the last non-empty row,
+ * which needs O(1) queries per row (amortised).
+ */
+class BeamTracker
 {
 public:
-    Coord coord{0, 0};
-    char value = 0;
-    bool visited = false;
+    // Max. nr of cells an edge moves per row: bounds the search in rows after empty rows
+    static const int MAX_EDGE_STEP = 10;
+
+    vector<long> left;
+    vector<long> right;
+    unsigned long queries = 0;
 
-    Point(int x, int y, char v) : value{v}
+    BeamTracker(const memory_t &data) : data{data}, drone{&data}
     {
-        coord = Coord(x, y);
     }
-    Point()
+
+    /**
+     * Asks the drone program if the cell is in the beam (the oracle)
+     */
+    bool query(long x, long y)
     {
+        queries++;
+        drone.reset(&data);
+        drone.inputValues.push(cpp_int(x));
+        drone.inputValues.push(cpp_int(y));
+        drone.runProgram();
+        return drone.output == 1;
     }
-};
 
-typedef vector<Point> map_line_t;
-typedef vector<map_line_t> map_t;
-map_t tractorMap;
+    /**
+     * Tracks the edges of all rows up to (including) row y
+     */
+    void trackUntil(long y)
+    {
+        while (static_cast<long>(left.size()) <= y)
+        {
+            trackNextRow();
+        }
+    }
 
-/**
- * Prints the map in its current state as ASCII Art
- */
-void printMap()
-{
-    for (auto l : tractorMap)
+    /**
+     * Nr of cells in the beam in the size x size area at 0/0
+     */
+    long countAffected(long size)
     {
-        for (auto c : l)
+        trackUntil(size - 1);
+        long count = 0;
+        for (long y = 0; y < size; y++)
         {
-            cout << (c.value == 0 ? '.' : (c.value == 1 ? '#' : '?'));
+            count += max(0l, min(right[y], size) - min(left[y], size));
         }
-        cout << endl;
+        return count;
     }
-}
+
+    /**
+     * Finds the square of size x size cells that fits into the beam and is closest to the emitter.
+     * The square's lower-left corner is the left edge of its bottom row, so for each bottom row
+     * we only have to check if the top row reaches far enough to the right.
+     */
+    Coord findSquare(long size)
+    {
+        for (long y = size - 1;; y++)
+        {
+            trackUntil(y);
+            long x = left[y];
+            long top = y - size + 1;
+            if (left[y] < right[y] && right[top] >= x + size)
+            {
+                return Coord(x, top);
+            }
+        }
+    }
+
+private:
+    const memory_t &data;
+    Program drone;
+    long lastLeft = 0;
+    long lastRight = 0;
+    long lastY = -1;
+
+    void trackNextRow()
+    {
+        long y = left.size();
+        long rowLeft = lastLeft;
+        // Left edge: the first beam cell right of the last left edge
+        long limit = lastRight + MAX_EDGE_STEP * (y - lastY);
+        while (rowLeft <= limit && !query(rowLeft, y))
+        {
+            rowLeft++;
+        }
+        if (rowLeft > limit)
+        {
+            // empty row (near the emitter, the beam is too narrow to hit every row)
+            left.push_back(lastRight);
+            right.push_back(lastRight);
+            return;
+        }
+        // Right edge: the first empty cell right of the beam, starting at the last right edge
+        long rowRight = max(rowLeft + 1, lastRight);
+        while (query(rowRight, y))
+        {
+            rowRight++;
+        }
+        left.push_back(rowLeft);
+        right.push_back(rowRight);
+        lastLeft = rowLeft;
+        lastRight = rowRight;
+        lastY = y;
+    }
+};
 
 /**
- * Starts solution 1
+ * A packed bitmap of the beam: one bit per cell, 64-bit words per row
  */
-int solution1(memory_t &data)
+class BeamBitmap
 {
-    map_line_t line;
-    int counter = 0;
-    int maxX = 50, maxY = 50;
-    for (int y = 0; y < maxY; y++)
+public:
+    long width;
+    long height;
+    long wordsPerRow;
+    vector<uint64_t> words;
+
+    BeamBitmap(long width, long height) : width{width}, height{height}, wordsPerRow{(width + 63) / 64}
+    {
+        words.resize(height * wordsPerRow, 0);
+    }
+
+    void set(long x, long y)
+    {
+        words[y * wordsPerRow + x / 64] |= uint64_t(1) << (x % 64);
+    }
+
+    bool get(long x, long y) const
     {
-        line.clear();
-        for (int x = 0; x < maxX; x++)
+        return (words[y * wordsPerRow + x / 64] >> (x % 64)) & 1;
+    }
+
+    /**
+     * Sets the cells from <= x < to in a row, word by word
+     */
+    void setRange(long from, long to, long y)
+    {
+        uint64_t *row = &words[y * wordsPerRow];
+        while (from < to)
         {
-            Program program(&data);
-            program.inputValues.push(cpp_int(x));
-            program.inputValues.push(cpp_int(y));
-            program.runProgram();
-            char output = static_cast<char>(program.output);
-            line.push_back(Point(x, y, output));
-            if (output == 1)
-            {
-                counter++;
-            }
+            long bit = from % 64;
+            long len = min(64 - bit, to - from);
+            uint64_t mask = len == 64 ? ~uint64_t(0) : ((uint64_t(1) << len) - 1) << bit;
+            row[from / 64] |= mask;
+            from += len;
         }
-        tractorMap.push_back(line);
     }
-    return counter;
-}
 
-char calcBeamPos(int x, int y, memory_t &data)
+    long count() const
+    {
+        long count = 0;
+        for (auto w : words)
+        {
+            count += __builtin_popcountll(w);
+        }
+        return count;
+    }
+};
+
+/**
+ * Asks a drone program if the cell is in the beam. The drone is pre-loaded, and only reset per query.
+ */
+bool queryDrone(Program &drone, const memory_t &data, long x, long y)
 {
-    Program program(&data);
-    program.inputValues.push(cpp_int(x));
-    program.inputValues.push(cpp_int(y));
-    program.runProgram();
-    char output = static_cast<char>(program.output);
-    return output;
+    drone.reset(&data);
+    drone.inputValues.push(cpp_int(x));
+    drone.inputValues.push(cpp_int(y));
+    drone.runProgram();
+    return drone.output == 1;
 }
 
 /**
- * Starts solution 2
+ * Scans the whole bitmap area with a pool of workers.
+ *
+ * The rows are split into bands, which the workers fetch one by one. Each worker has its own
+ * pre-loaded drone program. A band's rows are only written by the worker that fetched it, so no locks are needed.
  *
- * Solution 1 shows that y / x varies between 0.85 and 0.95 (tends to become 0.91).
- * So I will try to find the fitting y position with a bisect algorithm:
- * For an y, which represents the lower-left corner of the ship, I calc if the ship fits in the beam by
- *   testint the calculated X values of lower-left x and upper-right x.
+ * exact: Every cell is queried, without any assumption about the beam's shape.
+ * Otherwise, the beam is assumed to be a cone (like BeamTracker does): In the first row of a band, a beam cell is
+ * searched near the predicted beam center (centerSlope * y), and the edges are found by exponential / binary search
+ * from there. The following rows of the band are tracked edge by edge, and filled word-wise.
  *
- * - Start at an arbitary y. Find the first x pos where x = '#' by starting at a lower bound x, then increase by one
- * - calc the upper-right x of the ship, and check if it fits EXACTLY in.
- * - If upper right x is on empty space, increase y (bisect)
- * - if upper right x is in '#', and right of it is '#' too, decrease y (bisect)
- * - if upper right x is in '#', and right of it is ' ', we found it!
+ * Returns the nr of drone queries.
  */
-int solution2(memory_t &data)
+unsigned long scanArea(const memory_t &data, BeamBitmap &bitmap, unsigned int nrOfWorkers, bool exact, double centerSlope)
 {
-    double lowerProportion = 0.85;
-    double upperProportion = 0.95;
-    int shipWidth = 100;
-    int minY = 10, maxY = 10000, actY = 0, minX = 0, maxX = 0;
-    while (minY < maxY)
-    {
-        actY = (maxY + minY) / 2;
-        minX = floor(actY / upperProportion);
-        maxX = ceil(actY / lowerProportion);
-        while (true)
-        {
-            // Step 1: Find lower y/x, where x is the first beam position
-            char leftOutput = calcBeamPos(minX, actY, data);
-            char rightOutput = calcBeamPos(minX + 1, actY, data);
-            if (leftOutput == 1)
-            {
-                // Not good, should not happen:
-                cerr << "Lower x bound too small, exit" << endl;
-                exit(1);
-            }
-            if (leftOutput == 0 && rightOutput == 1)
+    const long bandHeight = exact ? 16 : 256;
+    long nrOfBands = (bitmap.height + bandHeight - 1) / bandHeight;
+    atomic<long> nextBand{0};
+    vector<unsigned long> queries(nrOfWorkers, 0);
+    vector<thread> workers;
+    for (unsigned int w = 0; w < nrOfWorkers; w++)
+    {
+        workers.push_back(thread([&, w]() {
+            Program drone(&data);
+            auto inBeam = [&](long x, long y) {
+                queries[w]++;
+                return x >= 0 && queryDrone(drone, data, x, y);
+            };
+            for (long band = nextBand++; band < nrOfBands; band = nextBand++)
             {
-                // Found 1st x
-                // cout << "Found first x at: " << minX + 1 << " Y: " << actY << endl;
-                minX++;
-                break;
+                long left = -1, right = -1;
+                for (long y = band * bandHeight; y < min(bitmap.height, (band + 1) * bandHeight); y++)
+                {
+                    if (exact)
+                    {
+                        for (long x = 0; x < bitmap.width; x++)
+                        {
+                            if (inBeam(x, y))
+                            {
+                                bitmap.set(x, y);
+                            }
+                        }
+                        continue;
+                    }
+                    if (left >= 0)
+                    {
+                        // Track the edges from the row before:
+                        long limit = right + BeamTracker::MAX_EDGE_STEP;
+                        while (left <= limit && !inBeam(left, y))
+                        {
+                            left++;
+                        }
+                        if (left > limit)
+                        {
+                            left = -1;
+                        }
+                        else
+                        {
+                            right = max(right, left + 1);
+                            while (inBeam(right, y))
+                            {
+                                right++;
+                            }
+                        }
+                    }
+                    if (left < 0)
+                    {
+                        // Search a beam cell near the predicted center, alternating left / right:
+                        long center = lround(centerSlope * y);
+                        long maxDist = BeamTracker::MAX_EDGE_STEP * (y + 1);
+                        long x = -1;
+                        for (long d = 0; d <= maxDist && x < 0; d++)
+                        {
+                            if (inBeam(center + d, y))
+                            {
+                                x = center + d;
+                            }
+                            else if (d > 0 && inBeam(center - d, y))
+                            {
+                                x = center - d;
+                            }
+                        }
+                        if (x < 0)
+                        {
+                            // empty row
+                            continue;
+                        }
+                        // Edges: exponential search for a cell outside, then binary search for the edge
+                        long step = 1;
+                        while (inBeam(x - step, y))
+                        {
+                            step *= 2;
+                        }
+                        long outside = x - step, inside = x - step / 2;
+                        while (inside - outside > 1)
+                        {
+                            long mid = (inside + outside) / 2;
+                            (inBeam(mid, y) ? inside : outside) = mid;
+                        }
+                        left = inside;
+                        step = 1;
+                        while (inBeam(x + step, y))
+                        {
+                            step *= 2;
+                        }
+                        inside = x + step / 2;
+                        outside = x + step;
+                        while (outside - inside > 1)
+                        {
+                            long mid = (inside + outside) / 2;
+                            (inBeam(mid, y) ? inside : outside) = mid;
+                        }
+                        right = outside;
+                    }
+                    bitmap.setRange(min(left, bitmap.width), min(right, bitmap.width), y);
+                }
             }
-            else
+        }));
+    }
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    unsigned long total = 0;
+    for (auto q : queries)
+    {
+        total += q;
+    }
+    return total;
+}
+
+/**
+ * Scans the size x size area with scanArea. Smaller areas are checked against the edge tracker
+ * (which needs about as many queries as the scan, but on one thread).
+ */
+void runScan(const memory_t &data, long size, unsigned int nrOfWorkers, bool exact)
+{
+    // Predict the beam center from a row near the emitter:
+    BeamTracker tracker(data);
+    long sampleRow = min(size - 1, 100l);
+    tracker.trackUntil(sampleRow);
+    double centerSlope = (tracker.left[sampleRow] + tracker.right[sampleRow]) / 2.0 / max(1l, sampleRow);
+
+    BeamBitmap bitmap(size, size);
+    auto start = chrono::steady_clock::now();
+    unsigned long queries = scanArea(data, bitmap, nrOfWorkers, exact, centerSlope);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (size <= 100)
+    {
+        for (long y = 0; y < size; y++)
+        {
+            for (long x = 0; x < size; x++)
             {
-                minX++;
+                cout << (bitmap.get(x, y) ? '#' : '.');
             }
+            cout << endl;
         }
-        // Found min (left) x, check if ship fits into beam:
-        maxX = minX + shipWidth; // should be empty space
-        char leftOutput = calcBeamPos(maxX - 1, actY - shipWidth + 1, data);
-        char rightOutput = calcBeamPos(maxX, actY - shipWidth + 1, data);
-        if (leftOutput == 1 && rightOutput == 0)
-        {
-            // Ship fits perfectly, done!
-            minY = (actY - shipWidth + 1);
-            cout << "Ship fits at: " << minX << ":" << minY  << endl;
-            break;
-        }
-        else if (leftOutput == 1 && rightOutput == 1)
-        {
-            // beam already too broad, make Y smaller
-            maxY = actY;
-        }
-        else
+    }
+    long count = bitmap.count();
+    cout << "Scanned " << size << " x " << size << (exact ? " cell by cell" : " by edges") << " with "
+         << nrOfWorkers << " workers: " << count << " beam cells" << endl;
+    cout << queries << " drone queries in " << seconds << " s (" << static_cast<long>(queries / seconds) << " queries/s)" << endl;
+
+    long tracked = size <= 2000 ? tracker.countAffected(size) : count;
+    if (tracked != count)
+    {
+        cerr << "Error: the edge tracker counts " << tracked << " beam cells" << endl;
+        exit(1);
+    }
+}
+
+/**
+ * Prints the beam in the size x size area as ASCII Art
+ */
+void printMap(BeamTracker &tracker, long size)
+{
+    tracker.trackUntil(size - 1);
+    for (long y = 0; y < size; y++)
+    {
+        for (long x = 0; x < size; x++)
         {
-            // Beam too small, increase y
-            minY = actY;
+            cout << (x >= tracker.left[y] && x < tracker.right[y] ? '#' : '.');
         }
+        cout << endl;
     }
-    return 10000 * minX + minY;
+}
+
+/**
+ * Starts solution 1: Nr of beam cells in the areaSize x areaSize area
+ */
+long solution1(BeamTracker &tracker, long areaSize)
+{
+    return tracker.countAffected(areaSize);
+}
+
+/**
+ * Starts solution 2: Where does a ship of shipSize x shipSize fit into the beam?
+ */
+long solution2(BeamTracker &tracker, long shipSize)
+{
+    Coord pos = tracker.findSquare(shipSize);
+    cout << "Ship fits at: " << pos.x << ":" << pos.y << endl;
+    return 10000l * pos.x + pos.y;
 }
 
 int main(int argc, char *args[])
@@ -174,17 +416,35 @@ int main(int argc, char *args[])
     if (argc < 2)
     {
         cerr << "Error: give input file on command line" << endl;
+        cerr << "Optional: area size (default 50) and ship size (default 100)" << endl;
+        cerr << "      or: --scan <size> [--exact] [nr of workers] to scan the whole area into a bitmap" << endl;
         exit(1);
     }
-
     // Read input file:
     memory_t data;
     readIntcodeProgramFromFile(args[1], data);
 
-    int nrOfBeamPos = solution1(data);
-    printMap();
+    if (argc >= 4 && string("--scan").compare(args[2]) == 0)
+    {
+        bool exact = argc >= 5 && string("--exact").compare(args[4]) == 0;
+        int workersArg = exact ? 5 : 4;
+        unsigned int nrOfWorkers = argc > workersArg ? stoul(args[workersArg]) : max(1u, thread::hardware_concurrency());
+        runScan(data, stol(args[3]), nrOfWorkers, exact);
+        return 0;
+    }
+
+    long areaSize = argc >= 3 ? stol(args[2]) : 50;
+    long shipSize = argc >= 4 ? stol(args[3]) : 100;
+    BeamTracker tracker(data);
+
+    long nrOfBeamPos = solution1(tracker, areaSize);
+    if (areaSize <= 100)
+    {
+        printMap(tracker, areaSize);
+    }
     cout << "Solution 1: Nr of Tractor pos: " << nrOfBeamPos << endl;
-    int coordProd = solution2(data);
+    cout << "Drone queries: " << tracker.queries << endl;
+    long coordProd = solution2(tracker, shipSize);
     cout << "Solution 2: Ship Fit Coord Product: " << coordProd << endl;
-
+    cout << "Drone queries: " << tracker.queries << endl;
 }
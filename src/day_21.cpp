@@ -2,7 +2,14 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <set>
 #include <queue>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <algorithm>
 #include "common.h"
 #include "intcode.h"
 #include <boost/multiprecision/cpp_int.hpp>
@@ -14,18 +21,13 @@ using namespace boost;
 
 /**
  * Day 21 - Springdroid Adventure
- */
-
-
-
-
-
-/**
- * The robot jumps 4 tiles
+ *
+ * The robot jumps 4 tiles, and sees the next tiles through its sensors:
  * A - 1 tile away
  * B - 2 tiles away
  * C - 3 tiles away
  * D - 4 tiles away
+ * (and E - I, 5 to 9 tiles away, in RUN mode)
  *
  * J: Jump reg
  * T: Temp reg
@@ -34,88 +36,769 @@ using namespace boost;
  * OR X Y  --> Y = X | Y
  * NOT X Y --> Y = !X
  *
- * So we have to deal with a logic puzzle.
+ * So we have to deal with a logic puzzle - which is not solved by hand here, but by a synthesiser:
+ * It searches a short springscript that survives all hulls the droid has died on so far, and tries it
+ * on the droid. If the droid dies again, the new hull is learned, and the search goes on.
+ */
+
+const int MAX_INSTRUCTIONS = 15;
+
+const int OP_AND = 0;
+const int OP_OR = 1;
+const int OP_NOT = 2;
+
+/**
+ * A springscript instruction. Registers: 0 .. nrOfSensors-1 are the sensors A, B, ...,
+ * nrOfSensors is T, nrOfSensors + 1 is J. The target dst is T (0) or J (1) only.
+ */
+class Instruction
+{
+public:
+    int op;
+    int src;
+    int dst;
+
+    string toString(int nrOfSensors) const
+    {
+        const char *ops[] = {"AND", "OR", "NOT"};
+        auto reg = [&](int r) {
+            return r < nrOfSensors ? string(1, 'A' + r) : (r == nrOfSensors ? "T" : "J");
+        };
+        return string(ops[op]) + " " + reg(src) + " " + reg(nrOfSensors + dst);
+    }
+};
+
+/**
+ * Sensor bit mask at droid position pos: bit i is set if the tile pos + 1 + i is ground.
+ * Everything beyond the known hull is ground.
+ */
+unsigned sensorMask(const string &hull, int pos, int nrOfSensors)
+{
+    unsigned mask = 0;
+    for (int i = 0; i < nrOfSensors; i++)
+    {
+        int p = pos + 1 + i;
+        if (p >= static_cast<int>(hull.size()) || hull[p] == '#')
+        {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * Walks the droid over the known hulls natively, without the Intcode VM.
+ *
+ * A script is a boolean function over the sensor bit mask, so it is turned into its truth table first,
+ * bit-sliced: each register holds one bit per possible sensor mask (512 bits in RUN mode), so an
+ * instruction is a few word operations. A hull layout is a bit mask of its ground tiles, so a step
+ * of the droid is a shift and a table lookup.
+ */
+class HullEmulator
+{
+public:
+    static const int MAX_HULL_LENGTH = 48;
+
+    unsigned long evaluations = 0;
+
+    HullEmulator(int nrOfSensors) : nrOfSensors{nrOfSensors}
+    {
+        words = max(1, (1 << nrOfSensors) / 64);
+        for (int s = 0; s < nrOfSensors; s++)
+        {
+            for (unsigned sensors = 0; sensors < (1u << nrOfSensors); sensors++)
+            {
+                if ((sensors >> s) & 1)
+                {
+                    sensorTables[s][sensors / 64] |= uint64_t(1) << (sensors % 64);
+                }
+            }
+        }
+    }
+
+    /**
+     * Adds a hull from a death report line ('#' is ground, the droid starts on tile 0).
+     * Returns false if the layout is known already.
+     */
+    bool addLayout(const string &hull)
+    {
+        if (hull.size() > MAX_HULL_LENGTH)
+        {
+            cerr << "Error: hull too long for the emulator: " << hull << endl;
+            exit(1);
+        }
+        // Everything beyond the hull is ground:
+        uint64_t ground = ~uint64_t(0) << hull.size();
+        for (size_t i = 0; i < hull.size(); i++)
+        {
+            if (hull[i] == '#')
+            {
+                ground |= uint64_t(1) << i;
+            }
+        }
+        if (find(layouts.begin(), layouts.end(), ground) != layouts.end())
+        {
+            return false;
+        }
+        layouts.push_back(ground);
+        lengths.push_back(hull.size());
+        return true;
+    }
+
+    size_t nrOfLayouts() const
+    {
+        return layouts.size();
+    }
+
+    /**
+     * Does the droid make it across all known hulls with this script?
+     */
+    bool survivesAll(const vector<Instruction> &script)
+    {
+        evaluations++;
+        uint64_t regs[2][MAX_WORDS] = {}; // T, J
+        for (auto &i : script)
+        {
+            const uint64_t *x = i.src < nrOfSensors ? sensorTables[i.src] : regs[i.src - nrOfSensors];
+            uint64_t *y = regs[i.dst];
+            for (int w = 0; w < words; w++)
+            {
+                y[w] = i.op == OP_AND ? x[w] & y[w] : (i.op == OP_OR ? x[w] | y[w] : ~x[w]);
+            }
+        }
+        const uint64_t *jump = regs[1];
+        const uint64_t sensorBits = (uint64_t(1) << nrOfSensors) - 1;
+        for (size_t h = 0; h < layouts.size(); h++)
+        {
+            uint64_t ground = layouts[h];
+            for (int pos = 0; pos < lengths[h];)
+            {
+                unsigned sensors = (ground >> (pos + 1)) & sensorBits;
+                pos += ((jump[sensors / 64] >> (sensors % 64)) & 1) ? 4 : 1;
+                if (((ground >> pos) & 1) == 0)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    // 2^9 sensor masks in RUN mode:
+    static const int MAX_WORDS = 8;
+
+    int nrOfSensors;
+    int words;
+    uint64_t sensorTables[9][MAX_WORDS] = {};
+    vector<uint64_t> layouts;
+    vector<int> lengths;
+};
+
+/**
+ * A clause: an OR over sensor literals. Literal l reads sensor l / 2, negated if l is odd.
+ */
+class Clause
+{
+public:
+    vector<int> literals;
+
+    bool isSatisfied(unsigned sensors) const
+    {
+        for (int l : literals)
+        {
+            bool ground = (sensors >> (l / 2)) & 1;
+            if (ground != (l % 2 == 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Nr of instructions to compute the clause into a register. fresh: the register is still false,
+     * so the first sensor can be OR'ed in instead of double-inverting it.
+     */
+    int cost(bool fresh) const
+    {
+        int negated = nrOfNegated();
+        int positive = literals.size() - negated;
+        if (negated == 1)
+        {
+            return 1 + positive;
+        }
+        if (negated == 0)
+        {
+            return (fresh ? 1 : 2) + positive - 1;
+        }
+        // !a | !b | ... is computed as !(a & b & ...):
+        return (fresh ? 1 : 2) + negated - 1 + 1 + positive;
+    }
+
+    /**
+     * Appends the instructions computing the clause into T (dst 0) or J (dst 1).
+     */
+    void emit(int nrOfSensors, int dst, bool fresh, vector<Instruction> &script) const
+    {
+        vector<int> negated;
+        vector<int> positive;
+        for (int l : literals)
+        {
+            (l % 2 == 1 ? negated : positive).push_back(l / 2);
+        }
+        int self = nrOfSensors + dst;
+        size_t firstPositive = 0;
+        if (negated.size() == 1)
+        {
+            script.push_back({OP_NOT, negated[0], dst});
+        }
+        else
+        {
+            // Load the first sensor as it is, AND the other negated ones, and invert:
+            vector<int> &first = negated.empty() ? positive : negated;
+            if (fresh)
+            {
+                script.push_back({OP_OR, first[0], dst});
+            }
+            else
+            {
+                script.push_back({OP_NOT, first[0], dst});
+                script.push_back({OP_NOT, self, dst});
+            }
+            if (negated.empty())
+            {
+                firstPositive = 1;
+            }
+            else
+            {
+                for (size_t i = 1; i < negated.size(); i++)
+                {
+                    script.push_back({OP_AND, negated[i], dst});
+                }
+                script.push_back({OP_NOT, self, dst});
+            }
+        }
+        for (size_t i = firstPositive; i < positive.size(); i++)
+        {
+            script.push_back({OP_OR, positive[i], dst});
+        }
+    }
+
+private:
+    int nrOfNegated() const
+    {
+        int n = 0;
+        for (int l : literals)
+        {
+            n += l % 2;
+        }
+        return n;
+    }
+};
+
+/**
+ * Searches a springscript by trial and error, learning from the droid's death reports.
  *
- * The robot should jump, if the 4th tile is solid (1),
- * but any one between is a hole. So this can be expressed as logic statements:
+ * Enumerating instruction sequences blindly does not get far: there are 66 instructions in RUN mode,
+ * and even after merging the sequences which compute the same jump decisions on the known hulls,
+ * the search has 13000 states at length 3, and grows by more than 10 per instruction. So the search
+ * runs over the droid's behaviour instead: Which sensor patterns should make it jump, so that it
+ * survives all hulls it has died on so far? These decisions are searched by DFS over the hulls,
+ * walking before jumping.
  *
- * J = (!A | !B | !C) & D
+ * A script is then a CNF over the sensors: an AND over clauses, each clause an OR over max. 3 (maybe
+ * negated) sensors. It must accept all jump patterns, and reject each walk pattern with at least one
+ * clause - a decision set without such clauses is pruned right away. The clauses are picked greedily,
+ * and compiled to springscript (max. MAX_INSTRUCTIONS): the first clause is built in J, each further
+ * one in T, and AND'ed to J.
  *
- * Only problem: we have to deal with J and T as storage only.
+ * Each compiled script is checked on the HullEmulator against all known hulls, and shortened there by
+ * dropping instructions as long as it still survives them. So the Intcode VM only confirms the best
+ * candidates: they are tried in parallel on forks of the droid program, taken where it waits for the
+ * script. Each failure reports a new hull, which starts a new round.
  */
-void solution1(memory_t &data)
+class SpringscriptSynthesiser
 {
-    Program program(&data);
-    vector<string> commands{
-        "NOT A J", // !A --> J
-            "NOT B T", // !B --> T
-            "OR T J",  // !A | !B --> J
-            "NOT C T", // !C --> T
-            "OR T J",  // !A | !B | !C --> J
-            "AND D J",  // J & D --> J
-            "WALK"
-    };
+public:
+    unsigned long vmTrials = 0;
+    unsigned long searchNodes = 0;
+    unsigned long rounds = 0;
+    double vmMillis = 0;
+    HullEmulator emulator;
+
+    SpringscriptSynthesiser(const AsciiProgram &prompt, int nrOfSensors, const string &mode)
+        : emulator{nrOfSensors}, prompt{prompt}, nrOfSensors{nrOfSensors}, mode{mode}
+    {
+        nrOfWorkers = max(1u, thread::hardware_concurrency());
+        buildClauses();
+    }
+
+    /**
+     * Returns true if a script is found: script and damage are filled.
+     */
+    bool synthesise(vector<Instruction> &script, cpp_int &damage)
+    {
+        while (true)
+        {
+            rounds++;
+            vector<vector<Instruction>> candidates = findCandidates(MAX_CANDIDATES);
+            if (candidates.empty())
+            {
+                return false;
+            }
+            // The shortest ones go to the droid:
+            stable_sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return a.size() < b.size(); });
+            candidates.resize(min<size_t>(candidates.size(), nrOfWorkers));
+            long found = runBatch(candidates, damage);
+            if (found >= 0)
+            {
+                script = candidates[found];
+                return true;
+            }
+        }
+    }
+
+    size_t nrOfKnownHulls() const
+    {
+        return hulls.size();
+    }
+
+private:
+    // Max. nr of decision search nodes per round:
+    static const unsigned long MAX_SEARCH_NODES = 2000000;
+    static const int MAX_CLAUSE_SIZE = 3;
+    // Max. nr of candidates per round, checked natively:
+    static const size_t MAX_CANDIDATES = 64;
 
-    // Fill inputs:
-    for (auto c : commands)
+    const AsciiProgram &prompt;
+    int nrOfSensors;
+    string mode;
+    unsigned int nrOfWorkers;
+
+    vector<string> hulls;
+
+    vector<Clause> clauses;
+    size_t clauseWords;
+    // For each sensor pattern: bit set of the clauses it satisfies
+    vector<vector<uint64_t>> satisfiedBy;
+
+    // Decision search state:
+    map<unsigned, bool> decisions;
+    vector<unsigned> jumpPatterns;
+    vector<unsigned> walkPatterns;
+    unsigned long roundNodes;
+    size_t maxCandidates;
+    vector<vector<Instruction>> candidates;
+    set<string> candidateTexts;
+
+    /**
+     * All clauses with max. MAX_CLAUSE_SIZE literals, each sensor used once
+     */
+    void buildClauses()
     {
-        program.asciiInput(c);
+        clauses.clear();
+        vector<int> literals;
+        function<void(int)> add = [&](int fromSensor) {
+            if (!literals.empty())
+            {
+                clauses.push_back({literals});
+            }
+            if (static_cast<int>(literals.size()) == MAX_CLAUSE_SIZE)
+            {
+                return;
+            }
+            for (int s = fromSensor; s < nrOfSensors; s++)
+            {
+                for (int negated = 0; negated < 2; negated++)
+                {
+                    literals.push_back(2 * s + negated);
+                    add(s + 1);
+                    literals.pop_back();
+                }
+            }
+        };
+        add(0);
+
+        clauseWords = (clauses.size() + 63) / 64;
+        satisfiedBy.assign(1u << nrOfSensors, vector<uint64_t>(clauseWords, 0));
+        for (unsigned sensors = 0; sensors < satisfiedBy.size(); sensors++)
+        {
+            for (size_t c = 0; c < clauses.size(); c++)
+            {
+                if (clauses[c].isSatisfied(sensors))
+                {
+                    satisfiedBy[sensors][c / 64] |= uint64_t(1) << (c % 64);
+                }
+            }
+        }
     }
 
-    cpp_int last_output;
-    while (program.state != P_HALT) {
-        program.runProgram();
-        last_output = program.output;
-        if (last_output <= 255) {
-            cout << static_cast<char>(last_output);
+    /**
+     * Can a walk pattern still be rejected by one of the valid clauses?
+     */
+    bool isRejectable(unsigned sensors, const vector<uint64_t> &valid) const
+    {
+        for (size_t w = 0; w < clauseWords; w++)
+        {
+            if (valid[w] & ~satisfiedBy[sensors][w])
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Picks clauses greedily (most rejected walk patterns per instruction), and compiles them.
+     * Returns false if the script gets too long.
+     */
+    bool compileDecisions(const vector<uint64_t> &valid, vector<Instruction> &script) const
+    {
+        script.clear();
+        if (jumpPatterns.empty())
+        {
+            // Never jump: the empty script
+            return true;
+        }
+        vector<const Clause *> chosen;
+        vector<bool> rejected(walkPatterns.size(), false);
+        size_t nrOfRejected = 0;
+        while (nrOfRejected < walkPatterns.size())
+        {
+            long best = -1;
+            double bestScore = 0;
+            for (size_t c = 0; c < clauses.size(); c++)
+            {
+                if (((valid[c / 64] >> (c % 64)) & 1) == 0)
+                {
+                    continue;
+                }
+                int count = 0;
+                for (size_t p = 0; p < walkPatterns.size(); p++)
+                {
+                    count += !rejected[p] && !clauses[c].isSatisfied(walkPatterns[p]);
+                }
+                double score = count / (clauses[c].cost(false) + 1.0);
+                if (score > bestScore)
+                {
+                    best = c;
+                    bestScore = score;
+                }
+            }
+            if (best < 0)
+            {
+                return false;
+            }
+            chosen.push_back(&clauses[best]);
+            for (size_t p = 0; p < walkPatterns.size(); p++)
+            {
+                if (!rejected[p] && !clauses[best].isSatisfied(walkPatterns[p]))
+                {
+                    rejected[p] = true;
+                    nrOfRejected++;
+                }
+            }
+        }
+        if (chosen.empty())
+        {
+            // Always jump:
+            script.push_back({OP_NOT, nrOfSensors + 1, 1});
+            return true;
+        }
+
+        // J gets the clause which profits most from starting in a fresh register,
+        // and so does T for the first clause built there:
+        auto freshGain = [](const Clause *c) { return c->cost(false) - c->cost(true); };
+        auto byGain = [&](const Clause *a, const Clause *b) { return freshGain(a) > freshGain(b); };
+        stable_sort(chosen.begin(), chosen.end(), byGain);
+        chosen[0]->emit(nrOfSensors, 1, true, script);
+        for (size_t i = 1; i < chosen.size(); i++)
+        {
+            chosen[i]->emit(nrOfSensors, 0, i == 1, script);
+            script.push_back({OP_AND, nrOfSensors, 1});
+        }
+        return script.size() <= static_cast<size_t>(MAX_INSTRUCTIONS);
+    }
+
+    /**
+     * Drops instructions from a script as long as it still survives all known hulls
+     */
+    void minimise(vector<Instruction> &script)
+    {
+        for (size_t i = 0; i < script.size();)
+        {
+            vector<Instruction> shorter(script);
+            shorter.erase(shorter.begin() + i);
+            if (emulator.survivesAll(shorter))
+            {
+                script = shorter;
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    /**
+     * DFS over the droid's decisions, hull by hull, step by step. A sensor pattern gets the same
+     * decision everywhere, and a decision must not drop the droid into a hole.
+     */
+    void searchDecisions(size_t hullIndex, int pos, const vector<uint64_t> &valid)
+    {
+        if (candidates.size() >= maxCandidates || roundNodes >= MAX_SEARCH_NODES)
+        {
+            return;
+        }
+        roundNodes++;
+        if (hullIndex == hulls.size())
+        {
+            vector<Instruction> script;
+            if (compileDecisions(valid, script) && emulator.survivesAll(script))
+            {
+                minimise(script);
+                string text;
+                for (auto &i : script)
+                {
+                    text += i.toString(nrOfSensors) + "\n";
+                }
+                if (candidateTexts.insert(text).second)
+                {
+                    candidates.push_back(script);
+                }
+            }
+            return;
+        }
+        const string &hull = hulls[hullIndex];
+        if (pos >= static_cast<int>(hull.size()))
+        {
+            searchDecisions(hullIndex + 1, 0, valid);
+            return;
+        }
+
+        unsigned sensors = sensorMask(hull, pos, nrOfSensors);
+        auto known = decisions.find(sensors);
+        for (bool jump : {false, true})
+        {
+            int next = pos + (jump ? 4 : 1);
+            if ((known != decisions.end() && known->second != jump) ||
+                (next < static_cast<int>(hull.size()) && hull[next] == '.'))
+            {
+                continue;
+            }
+            if (known != decisions.end())
+            {
+                searchDecisions(hullIndex, next, valid);
+                continue;
+            }
+
+            // A new decision: check that all walk patterns can still be rejected
+            vector<uint64_t> newValid(valid);
+            bool possible = true;
+            if (jump)
+            {
+                for (size_t w = 0; w < clauseWords; w++)
+                {
+                    newValid[w] &= satisfiedBy[sensors][w];
+                }
+                for (unsigned walk : walkPatterns)
+                {
+                    possible = possible && isRejectable(walk, newValid);
+                }
+            }
+            else
+            {
+                possible = isRejectable(sensors, valid);
+            }
+            if (!possible)
+            {
+                continue;
+            }
+            vector<unsigned> &list = jump ? jumpPatterns : walkPatterns;
+            decisions[sensors] = jump;
+            list.push_back(sensors);
+            searchDecisions(hullIndex, next, newValid);
+            list.pop_back();
+            decisions.erase(sensors);
         }
     }
-    cout << "Solution 1: " << last_output << endl;
-    cout << endl;
-}
 
-/**       .
- * Solution 2:
+    vector<vector<Instruction>> findCandidates(size_t count)
+    {
+        candidates.clear();
+        candidateTexts.clear();
+        maxCandidates = count;
+        roundNodes = 0;
+        vector<uint64_t> valid(clauseWords, ~uint64_t(0));
+        searchDecisions(0, 0, valid);
+        searchNodes += roundNodes;
+        return candidates;
+    }
+
+    /**
+     * Tries a script on a fork of the droid program. On failure, hull receives the hull from the death report.
+     */
+    bool trial(const vector<Instruction> &script, cpp_int &damage, string &hull) const
+    {
+        AsciiProgram droid(prompt);
+        bool died = false;
+        bool nextIsHull = false;
+        droid.sink.onLine = [&](string_view line) {
+            if (line == "Didn't make it across:")
+            {
+                died = true;
+            }
+            else if (nextIsHull)
+            {
+                hull = string(line);
+                nextIsHull = false;
+            }
+            else if (died && hull.empty() && line.find('@') != string_view::npos)
+            {
+                // The first frame: the hull is below the droid
+                nextIsHull = true;
+            }
+        };
+        for (auto &i : script)
+        {
+            droid.asciiInput(i.toString(nrOfSensors));
+        }
+        droid.asciiInput(mode);
+        while (droid.state != P_HALT)
+        {
+            droid.runProgram();
+            if (droid.state == P_OUTPUT)
+            {
+                damage = droid.output;
+            }
+            else if (droid.state == P_INPUT)
+            {
+                cerr << "Error: the droid asks for more input than the script" << endl;
+                exit(1);
+            }
+        }
+        return !died && damage > 127;
+    }
+
+    /**
+     * Tries a batch of scripts in parallel. Returns the index of the first successful one, or -1:
+     * then the hulls of all failed scripts are learned.
+     */
+    long runBatch(const vector<vector<Instruction>> &batch, cpp_int &damage)
+    {
+        vector<char> success(batch.size(), false);
+        vector<cpp_int> damages(batch.size());
+        vector<string> failedHulls(batch.size());
+        auto start = chrono::steady_clock::now();
+        atomic<size_t> next{0};
+        auto work = [&]() {
+            for (size_t i = next++; i < batch.size(); i = next++)
+            {
+                success[i] = trial(batch[i], damages[i], failedHulls[i]);
+            }
+        };
+        vector<thread> workers;
+        for (unsigned int w = 1; w < min<size_t>(nrOfWorkers, batch.size()); w++)
+        {
+            workers.push_back(thread(work));
+        }
+        work();
+        for (auto &t : workers)
+        {
+            t.join();
+        }
+        vmTrials += batch.size();
+        vmMillis += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
- Add the requirement: AND (5th or 8th) must be a tile, too.
- This way the robot moves nearer to the abyss until jumping:
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (success[i])
+            {
+                damage = damages[i];
+                return i;
+            }
+        }
+        for (auto &hull : failedHulls)
+        {
+            if (hull.empty())
+            {
+                cerr << "Error: the droid failed without a death report" << endl;
+                exit(1);
+            }
+            if (emulator.addLayout(hull))
+            {
+                hulls.push_back(hull);
+            }
+        }
+        return -1;
+    }
+};
 
- So add AND (E OR H):
+/**
+ * Synthesises a script for the given mode (WALK: 4 sensors, RUN: 9 sensors), and prints it.
  */
-void solution2(memory_t &data) {
-    Program program(&data);
-    vector<string> commands{
-        // (!A | !B | !C) & D (from solution 1)
-        "NOT A J", // !A --> J
-            "NOT B T", // !B --> T
-            "OR T J",  // !A | !B --> J
-            "NOT C T", // !C --> T
-            "OR T J",  // !A | !B | !C --> J
-            "AND D J",  // J & D --> J
-
-            // AND (E OR H)
-            "NOT E T", // Store E value to T, by double-inverting it
-            "NOT T T",
-            "OR H T", // OR E with H
-            "AND T J", // AND (E OR H)
-            "RUN"
-    };
-
-    // Fill inputs:
-    for (auto c : commands)
-    {
-        program.asciiInput(c);
-    }
-
-    cpp_int last_output;
-    while (program.state != P_HALT) {
-        program.runProgram();
-        last_output = program.output;
-        if (last_output <= 255) {
-            cout << static_cast<char>(last_output);
-        }
-    }
-    cout << "Solution 2: " << last_output << endl;
+cpp_int synthesise(memory_t &data, int nrOfSensors, const string &mode)
+{
+    // Run the droid program until it waits for the script: all trials start from here.
+    AsciiProgram prompt(&data);
+    prompt.runProgram();
+    if (prompt.state != P_INPUT)
+    {
+        cerr << "Error: the droid does not ask for a script" << endl;
+        exit(1);
+    }
+
+    auto start = chrono::steady_clock::now();
+    SpringscriptSynthesiser synthesiser(prompt, nrOfSensors, mode);
+    vector<Instruction> script;
+    cpp_int damage;
+    if (!synthesiser.synthesise(script, damage))
+    {
+        cerr << "Error: no " << mode << " script with max. " << MAX_INSTRUCTIONS << " instructions found" << endl;
+        exit(1);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    for (auto &i : script)
+    {
+        cout << i.toString(nrOfSensors) << endl;
+    }
+    cout << mode << endl;
+    cout << "Found in " << ms << " ms: " << synthesiser.rounds << " rounds, " << synthesiser.vmTrials << " droid trials, "
+         << synthesiser.nrOfKnownHulls() << " hulls learned, " << synthesiser.searchNodes << " decision search nodes" << endl;
+
+    // Native vs. VM cost of testing a script:
+    const int repeats = 1000000;
+    unsigned long survived = 0;
+    auto benchStart = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        survived += synthesiser.emulator.survivesAll(script);
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - benchStart).count() / repeats;
+    if (survived != repeats)
+    {
+        cerr << "Error: the emulator lets the droid die, but it made it across" << endl;
+        exit(1);
+    }
+    cout << "Emulator: " << synthesiser.emulator.evaluations - repeats << " script checks during the search, "
+         << ns << " ns per check over " << synthesiser.emulator.nrOfLayouts() << " hulls, droid trial: "
+         << synthesiser.vmMillis / synthesiser.vmTrials << " ms" << endl;
+    return damage;
+}
+
+void solution1(memory_t &data)
+{
+    cpp_int damage = synthesise(data, 4, "WALK");
+    cout << "Solution 1: " << damage << endl;
+    cout << endl;
+}
+
+void solution2(memory_t &data)
+{
+    cpp_int damage = synthesise(data, 9, "RUN");
+    cout << "Solution 2: " << damage << endl;
     cout << endl;
 }
 
@@ -2,6 +2,10 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
 #include "common.h"
 
 using namespace std;
@@ -12,12 +16,52 @@ using namespace std;
  * Part 1 - easy, but I guess that will not work for part 2
  * Part 2 - as I thought - not possible with the naive solution from part 1
  *          Another detective puzzle, I guess. Some number inspection needs to be done here.
+ *
+ *          Solved: each technique only moves a card from position x to a * x + b (mod deck size),
+ *          so a whole shuffle is one such affine map, and 101741582076661 shuffles are that map
+ *          raised to the power, by square-and-multiply. No deck needed at all.
  */
 
-int deckSize = 10007;
-typedef vector<int> deck_t;
-deck_t* deck = new deck_t(deckSize);
-deck_t* tempDeck = new deck_t(deckSize);
+long deckSize = 10007;
+typedef vector<uint32_t> deck_t;
+deck_t* deck = nullptr;
+deck_t* tempDeck = nullptr;
+
+// How many cards ahead the increment scatter prefetches its target:
+const long PREFETCH_DISTANCE = 16;
+
+enum Technique { NEW_STACK, CUT, INCREMENT };
+
+/**
+ * A parsed shuffle technique: the commands are only parsed once, not on every pass.
+ */
+class Command {
+    public:
+        Technique technique;
+        int64_t n;
+};
+
+vector<Command> compileCommands(const vector<string> &commands) {
+    vector<Command> program;
+    for (auto &line : commands) {
+        if (line == "deal into new stack") {
+            program.push_back({NEW_STACK, 0});
+        } else if (line.substr(0,3) == "cut") {
+            program.push_back({CUT, stoll(line.substr(4))});
+        } else if (line.substr(0,9) == "deal with") {
+            int64_t n = stoll(line.substr(20));
+            if (n <= 0) {
+                cerr << "Error: increment must be positive: " << line << endl;
+                exit(1);
+            }
+            program.push_back({INCREMENT, n});
+        } else if (!line.empty()) {
+            cerr << "Error: unknown technique: " << line << endl;
+            exit(1);
+        }
+    }
+    return program;
+}
 
 void swapDecks() {
     deck_t* tmp = deck;
@@ -26,61 +70,183 @@ void swapDecks() {
 }
 
 void fillDeck() {
-    for (auto i = 0; i < deckSize; i++) {
+    delete deck;
+    delete tempDeck;
+    deck = new deck_t(deckSize);
+    tempDeck = new deck_t(deckSize);
+    for (long i = 0; i < deckSize; i++) {
         (*deck)[i] = i;
     }
 }
 
 void dealIntoNewStack() {
-    for (auto i = 0; i < deckSize; ++i) {
-        ( *tempDeck )[i] = (*deck)[deckSize - i - 1];
-    }
+    reverse_copy(deck->begin(), deck->end(), tempDeck->begin());
     swapDecks();
 }
 
-void cutNCards(int n) {
-    int offset = (deckSize + n) % deckSize;
-    for (auto i = 0; i < deckSize; ++i) {
-        (*tempDeck)[i] = (*deck)[(i + offset) % deckSize];
-    }
+/**
+ * std::rotate semantics: two block copies, no modulo per card
+ */
+void cutNCards(int64_t n) {
+    long offset = (n % deckSize + deckSize) % deckSize;
+    auto tail = copy(deck->begin() + offset, deck->end(), tempDeck->begin());
+    copy(deck->begin(), deck->begin() + offset, tail);
     swapDecks();
 }
 
-void dealWithIncrement(int n) {
-    int offset = 0;
-    for (auto i = 0; i < deckSize; ++i) {
-        offset = (i * n) % deckSize;
-        (*tempDeck)[offset] = (*deck)[i];
+/**
+ * A strided scatter: the target position wraps around by subtraction instead of a modulo,
+ * and the target cache line is prefetched some cards ahead.
+ */
+void dealWithIncrement(int64_t n) {
+    long step = (n % deckSize + deckSize) % deckSize;
+    if (gcd(step, deckSize) != 1) {
+        // Some positions would be dealt twice, and others never
+        cerr << "Error: deal with increment " << n << " is no shuffle for a deck of " << deckSize << " cards" << endl;
+        exit(1);
+    }
+    long pos = 0;
+    long ahead = (PREFETCH_DISTANCE * step) % deckSize;
+    uint32_t *from = deck->data();
+    uint32_t *to = tempDeck->data();
+    for (long i = 0; i < deckSize; ++i) {
+        __builtin_prefetch(to + ahead, 1);
+        to[pos] = from[i];
+        pos += step;
+        if (pos >= deckSize) {
+            pos -= deckSize;
+        }
+        ahead += step;
+        if (ahead >= deckSize) {
+            ahead -= deckSize;
+        }
     }
     swapDecks();
 }
 
 
 void printDeck() {
-    for (auto i = 0; i < deckSize; ++i) {
+    for (long i = 0; i < deckSize; ++i) {
         cout << (*deck)[i] << " ";
     }
     cout << endl;
 }
 
-void applyCommands(vector<string> &commands)
+void applyCommands(const vector<Command> &program)
 {
-    for (auto line : commands) {
-        if (line == "deal into new stack") {
-            dealIntoNewStack();
-        } else if (line.substr(0,3) == "cut") {
-            int n = stoi(line.substr(4));
-            cutNCards(n);
-        } else if (line.substr(0,9) == "deal with") {
-            int n = stoi(line.substr(20));
-            dealWithIncrement(n);
+    for (auto &command : program) {
+        switch (command.technique) {
+            case NEW_STACK:
+                dealIntoNewStack();
+                break;
+            case CUT:
+                cutNCards(command.n);
+                break;
+            case INCREMENT:
+                dealWithIncrement(command.n);
+                break;
         }
     }
 }
 
-void solution1(vector<string> &commands) {
+/**
+ * A shuffle as affine map over the card positions: x -> a * x + b (mod m).
+ * m is below 2^63, so the products are done in 128 bit.
+ */
+class AffineMap {
+    public:
+        int64_t a;
+        int64_t b;
+        int64_t m;
+
+        static int64_t mulMod(int64_t x, int64_t y, int64_t m) {
+            return static_cast<int64_t>(static_cast<__int128>(x) * y % m);
+        }
+
+        static int64_t mod(int64_t x, int64_t m) {
+            x %= m;
+            return x < 0 ? x + m : x;
+        }
+
+        /**
+         * The map of a single technique
+         */
+        static AffineMap of(const Command &command, int64_t m) {
+            switch (command.technique) {
+                case NEW_STACK:
+                    return {m - 1, m - 1, m};
+                case CUT:
+                    return {1, mod(-command.n, m), m};
+                default:
+                    return {mod(command.n, m), 0, m};
+            }
+        }
+
+        /**
+         * The map of the whole shuffle: all techniques, composed
+         */
+        static AffineMap ofShuffle(const vector<Command> &program, int64_t m) {
+            AffineMap shuffle{1, 0, m};
+            for (auto &command : program) {
+                shuffle = shuffle.then(of(command, m));
+            }
+            return shuffle;
+        }
+
+        /**
+         * First this map, then other: other(this(x))
+         */
+        AffineMap then(const AffineMap &other) const {
+            return {mulMod(other.a, a, m), mod(mulMod(other.a, b, m) + other.b, m), m};
+        }
+
+        /**
+         * This map, applied n times - by square-and-multiply, in O(log n)
+         */
+        AffineMap power(int64_t n) const {
+            AffineMap result{1, 0, m};
+            AffineMap square = *this;
+            while (n > 0) {
+                if (n & 1) {
+                    result = result.then(square);
+                }
+                square = square.then(square);
+                n >>= 1;
+            }
+            return result;
+        }
+
+        /**
+         * Position of the card which was at position x before
+         */
+        int64_t forward(int64_t x) const {
+            return mod(mulMod(a, x, m) + b, m);
+        }
+
+        /**
+         * Position before the shuffle of the card which is at position y now:
+         * x = (y - b) / a, with the modular inverse of a (extended Euclid, in O(log m))
+         */
+        int64_t inverse(int64_t y) const {
+            int64_t r0 = m, r1 = a, t0 = 0, t1 = 1;
+            while (r1 != 0) {
+                int64_t q = r0 / r1;
+                int64_t r2 = r0 - q * r1;
+                int64_t t2 = mod(t0 - mulMod(q, t1, m), m);
+                r0 = r1; r1 = r2;
+                t0 = t1; t1 = t2;
+            }
+            if (r0 != 1) {
+                cerr << "Error: the shuffle is not invertible" << endl;
+                exit(1);
+            }
+            return mulMod(mod(y - b, m), t0, m);
+        }
+};
+
+void solution1(const vector<Command> &program) {
     fillDeck();
-    applyCommands(commands);
+    applyCommands(program);
 
     // Now, search card # 2019's pos:
     for (int i = 0; i < deckSize; ++i) {
@@ -88,14 +254,50 @@ void solution1(vector<string> &commands) {
             cout << "Solution 1: Card 2019 has position: " << i << endl;
         }
     }
+
+    // Cross-check with the affine map:
+    AffineMap shuffle = AffineMap::ofShuffle(program, deckSize);
+    cout << "Affine map: card 2019 has position: " << shuffle.forward(2019) << endl;
 }
 
-void solution2(vector<string> &commands) {
+void solution2(const vector<Command> &program) {
+    const int64_t cards = 119315717514047;
+    const int64_t repetitions = 101741582076661;
+
+    AffineMap shuffle = AffineMap::ofShuffle(program, cards).power(repetitions);
+    int64_t card = shuffle.inverse(2020);
+    cout << "Solution 2: Card at position 2020: " << card << endl;
+    if (shuffle.forward(card) != 2020) {
+        cerr << "Error: forward and inverse map do not agree" << endl;
+        exit(1);
+    }
+}
+
+/**
+ * Shuffles a full deck of the given size, and checks it against the affine map
+ */
+void shuffleBenchmark(const vector<Command> &program, long size) {
+    if (size < 1 || size > UINT32_MAX) {
+        cerr << "Error: deck size must be in 1.." << UINT32_MAX << endl;
+        exit(1);
+    }
+    AffineMap shuffle = AffineMap::ofShuffle(program, size);
+
+    deckSize = size;
     fillDeck();
-    for (int i = 0; i < 1000; i++) {
-        applyCommands(commands);
-        cout << (*deck)[2020] << endl;
+    auto start = chrono::steady_clock::now();
+    applyCommands(program);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Shuffled " << deckSize << " cards with " << program.size() << " techniques in " << ms << " ms ("
+         << ms * 1e6 / (static_cast<double>(deckSize) * program.size()) << " ns per card and technique)" << endl;
+
+    for (long card = 0; card < deckSize; card += max(1l, deckSize / 1000)) {
+        if ((*deck)[shuffle.forward(card)] != card) {
+            cerr << "Error: card " << card << " is not where the affine map puts it" << endl;
+            exit(1);
+        }
     }
+    cout << "Checked against the affine map" << endl;
 }
 
 int main(int argc, char *args[])
@@ -110,9 +312,14 @@ int main(int argc, char *args[])
     // Read input file:
     vector<string> inputLines;
     readLines(args[1],  inputLines);
+    vector<Command> program = compileCommands(inputLines);
 
+    if (argc >= 4 && string("--deck-size").compare(args[2]) == 0) {
+        shuffleBenchmark(program, stol(args[3]));
+        return 0;
+    }
 
-    solution1(inputLines);
+    solution1(program);
 
-    solution2(inputLines);
+    solution2(program);
 }
@@ -8,6 +8,10 @@
 #include <boost/multiprecision/cpp_int.hpp>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 
 using namespace std;
 using namespace boost::multiprecision;
@@ -17,11 +21,17 @@ using namespace boost;
 /**
  * Day 23 - Category Six
  *
- * Setting up a thread for each NIC Intcode program
+ * Default: A deterministic, single-threaded network simulation (see simulate()):
+ * All NICs are run round-robin, each until it waits for input.
  *
- * Somehow the input queue read (getInputValue) needs to sleep for some ms
- * if no input was in the queue to make this work - why?
- * I have no idea...
+ * With --threaded: Setting up a thread for each NIC Intcode program.
+ * Idleness is detected by counters instead of polling: The NAT knows how many
+ * values are in flight (sent, but not yet read), and how many NICs are idle. A NIC is
+ * idle after it read -1 twice in a row without receiving or sending anything in between.
+ * When the last NIC gets idle and nothing is in flight, the NAT is woken up.
+ *
+ * With --threaded --telemetry <file>, per-node counters are written as CSV snapshots
+ * to the given file periodically.
  */
 
 // Forward declaration of Nic:
@@ -31,20 +41,49 @@ class NAT;
 // Our nic container
 vector<std::shared_ptr<Nic>> nics;
 
+/**
+ * Per-NIC telemetry counters: Lock-free, so they can be updated by the NIC threads
+ * and read by the snapshot writer at any time.
+ */
+struct NicTelemetry {
+    std::atomic<unsigned long> packetsSent{0};
+    std::atomic<unsigned long> packetsReceived{0};
+    std::atomic<unsigned long> queueHighWater{0};
+    std::atomic<unsigned long> blockedNanos{0};
+    std::atomic<unsigned long> instructions{0};
+};
+
 class NAT {
     private:
         std::mutex m;
+        std::condition_variable cv;
+        bool hasPacket = false;
         cpp_int packetX = 0;
         cpp_int packetY = 0;
         cpp_int lastYValueSent = 0;
 
     public:
+        // Nr of values pushed to NIC input queues, but not yet read:
+        std::atomic<long> inFlight{0};
+        // Nr of NICs that are idle:
+        std::atomic<unsigned int> idleNics{0};
+        std::atomic<bool> shutdown{false};
+        std::atomic<unsigned long> injections{0};
+
         void sendPacket(cpp_int x, cpp_int y) {
-            m.lock();
-            cout << "NAT has received packet: " << x << ":" << y << endl;
+            std::lock_guard<std::mutex> lock(m);
             packetX = x;
             packetY = y;
-            m.unlock();
+            hasPacket = true;
+        }
+
+        /**
+         * Called by a NIC that just got idle: wakes up the NAT, so it can check for quiescence
+         */
+        void nicIdle() {
+            idleNics++;
+            std::lock_guard<std::mutex> lock(m);
+            cv.notify_one();
         }
 
     void checkIdle();
@@ -54,55 +93,96 @@ class NAT {
 // The NAT:
 NAT nat;
 
-class Nic : public Program
+std::atomic<bool> solution1Found{false};
+
+class Nic : public ProgramBase<Nic>
 {
     private:
         std::mutex m;
-        std::mutex wm;
+        std::condition_variable cv;
+        // Nr of -1 reads in a row since the last activity (receive / send), guarded by m:
+        unsigned int idleEpoch = 0;
+
+        void markActiveLocked() {
+            if (idleEpoch >= 2) {
+                nat.idleNics--;
+            }
+            idleEpoch = 0;
+        }
 
     public:
+        NicTelemetry telemetry;
 
-        Nic(memory_t *mem) : Program(mem) { }
+        Nic(memory_t *mem) : ProgramBase<Nic>(mem) { }
+
+        bool hasInputValue() {
+            return true;
+        }
 
         /**
          * Override getInputValue: If the queue is empty, provide -1 as input value
          *
-         * Thread-safe read, and also sleeps for some ms when requesting empty values.
-         * Why? No idea - without the sleep it just did not work...
+         * Once the NIC is idle, reading -1 again and again is the same as waiting
+         * for the next packet - so the thread just blocks until a packet arrives.
+         * On shutdown, the NIC program is halted.
          */
-        cpp_int getInputValue() override {
-            cpp_int val;
-            m.lock();
+        cpp_int getInputValue() {
+            telemetry.instructions.store(this->executedInstructions, std::memory_order_relaxed);
+            std::unique_lock<std::mutex> lock(m);
+            if (this->inputValues.empty() && idleEpoch >= 2) {
+                auto start = std::chrono::steady_clock::now();
+                cv.wait(lock, [this]() { return !this->inputValues.empty() || nat.shutdown; });
+                auto blocked = std::chrono::steady_clock::now() - start;
+                telemetry.blockedNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(blocked).count(),
+                                                 std::memory_order_relaxed);
+            }
+            if (nat.shutdown) {
+                this->state = P_HALT;
+                return cpp_int(-1);
+            }
             if (this->inputValues.empty()) {
-                val = cpp_int(-1);
-            } else {
-                std::this_thread::sleep_for(std::chrono::milliseconds(20));
-                val = this->inputValues.front();
-                this->inputValues.pop();
+                if (++idleEpoch == 2) {
+                    lock.unlock();
+                    nat.nicIdle();
+                }
+                return cpp_int(-1);
             }
-            m.unlock();
+            markActiveLocked();
+            cpp_int val = this->inputValues.front();
+            this->inputValues.pop();
+            nat.inFlight--;
             return val;
         }
 
-        bool isIdle()
-        {
-            bool idle = false;
-            m.lock();
-            if (this->inputValues.empty()) {
-                idle = true;
-            }
-            m.unlock();
-            return idle;
+        /**
+         * Sending a packet is an activity, too
+         */
+        void markActive() {
+            std::lock_guard<std::mutex> lock(m);
+            markActiveLocked();
         }
 
         /**
          * thread-safe way to put things in queue, so that the items are in-order
          */
         void pushInputValues(cpp_int xVal, cpp_int yVal) {
-            wm.lock();
+            std::lock_guard<std::mutex> lock(m);
+            nat.inFlight += 2;
             this->inputValues.push(xVal);
             this->inputValues.push(yVal);
-            wm.unlock();
+            telemetry.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+            if (this->inputValues.size() > telemetry.queueHighWater.load(std::memory_order_relaxed)) {
+                telemetry.queueHighWater.store(this->inputValues.size(), std::memory_order_relaxed);
+            }
+            cv.notify_one();
+        }
+
+        /**
+         * Wakes up a waiting NIC, e.g. on shutdown
+         */
+        void wakeUp() {
+            std::lock_guard<std::mutex> lock(m);
+            cv.notify_one();
         }
 
         /**
@@ -113,29 +193,35 @@ class Nic : public Program
          */
         void operator()()
         {
+            vector<cpp_int> packet;
             while (true) {
-                // 1st output: dest address
+                // outputs: dest address, x value, y value
                 this->runProgram();
-                auto destAddr = this->output;
-
-                // 2nd output: x value
-                this->runProgram();
-                auto xVal = this->output;
+                if (this->state == P_HALT) {
+                    break;
+                }
+                packet.push_back(this->output);
+                if (packet.size() < 3) {
+                    continue;
+                }
+                auto destAddr = packet[0];
+                auto xVal = packet[1];
+                auto yVal = packet[2];
+                packet.clear();
+                markActive();
+                telemetry.packetsSent.fetch_add(1, std::memory_order_relaxed);
 
-                // 3rd output: y value
-                this->runProgram();
-                auto yVal = this->output;
-                // cout << "NIC #" << this->pNr << ": Received values: " << destAddr << ":" << xVal << ":" << yVal <<endl;
                 // Have we reached solution 1?
                 if (destAddr == 255) {
-                    cout << "Solution 1: Y Value sent to Addr 255: " << yVal << endl;
+                    if (!solution1Found.exchange(true)) {
+                        cout << "Solution 1: Y Value sent to Addr 255: " << yVal << endl;
+                    }
                     // Send value to NAT:
                     nat.sendPacket(xVal, yVal);
                 }
 
                 // Send the packet to its destination:
                 if (destAddr>= 0 && destAddr < nics.size()) {
-                    cout << "NIC #" << this->pNr << ": Send values to NIC # " << destAddr << ":" << xVal << ":" << yVal <<endl;
                     auto addr = static_cast<unsigned int>(destAddr);
                     (nics[addr])->pushInputValues(xVal, yVal);
                 }
@@ -143,53 +229,209 @@ class Nic : public Program
         }
 };
 
+/**
+ * Waits until the network is quiescent: All NICs idle, and no value in flight.
+ * As long as that is the case, no NIC can send anything, so the check cannot be spurious.
+ */
 void NAT::checkIdle()
 {
-    set<cpp_int> seenValues;
+    bool sentBefore = false;
+    std::unique_lock<std::mutex> lock(m);
     while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        cout << "NAT is looking for idleness ..." << endl;
+        cv.wait(lock, [this]() {
+            return hasPacket && idleNics == nics.size() && inFlight == 0;
+        });
+        cout << "NAT Detected Idleness... So sad! Send " << packetX << ":" << packetY << " to 0." << endl;
+        if (sentBefore && lastYValueSent == packetY) {
+            cout << "Solution 2: NAT delivered the same Y value twice in a row: " << packetY << endl;
+            break;
+        }
+        sentBefore = true;
+        lastYValueSent = packetY;
+        injections++;
+        (nics[0])->pushInputValues(packetX, packetY);
+    }
+    shutdown = true;
+    lock.unlock();
+    for (auto n : nics) {
+        n->wakeUp();
+    }
+}
+
+/**
+ * A NIC in the simulated network: Uses the default input queue, so it stops with P_INPUT
+ * as soon as it waits for a packet. The simulator then decides if it gets -1.
+ */
+class SimNic : public ProgramBase<SimNic>
+{
+    public:
+        // did the NIC read -1 (no packet) since the last packet it received?
+        bool idle = false;
+        vector<cpp_int> packet;
+
+        SimNic(memory_t *mem) : ProgramBase<SimNic>(mem) { }
+};
+
+/**
+ * Deterministic network simulation:
+ *
+ * In each round, every NIC runs until it waits for input on an empty queue. If its queue
+ * was empty at the start of its turn, it receives -1 (and counts as idle).
+ * Sent packets are delivered to the destination's queue immediately.
+ *
+ * The network is idle when a full round has passed where no packet was sent,
+ * all queues are empty and every NIC has read -1. Then the NAT sends its last packet to NIC 0.
+ */
+void simulate(memory_t &data)
+{
+    const unsigned int nrOfNics = 50;
+    vector<SimNic *> simNics;
+    for (unsigned int i = 0; i < nrOfNics; i++) {
+        SimNic *nic = new SimNic(&data);
+        nic->pNr = i;
+        nic->inputValues.push(cpp_int(i));
+        simNics.push_back(nic);
+    }
+
+    bool natHasPacket = false;
+    bool solution1Found = false;
+    cpp_int natX = 0, natY = 0;
+    bool natSent = false;
+    cpp_int lastNatY = 0;
+    unsigned long rounds = 0;
+
+    while (true) {
+        rounds++;
+        bool packetSent = false;
+        for (auto nic : simNics) {
+            if (nic->inputValues.empty()) {
+                nic->inputValues.push(cpp_int(-1));
+                nic->idle = true;
+            }
+            nic->runProgram();
+            while (nic->state == P_OUTPUT) {
+                nic->packet.push_back(nic->output);
+                if (nic->packet.size() == 3) {
+                    packetSent = true;
+                    cpp_int destAddr = nic->packet[0];
+                    if (destAddr == 255) {
+                        if (!solution1Found) {
+                            cout << "Solution 1: Y Value sent to Addr 255: " << nic->packet[2] << endl;
+                            solution1Found = true;
+                        }
+                        natX = nic->packet[1];
+                        natY = nic->packet[2];
+                        natHasPacket = true;
+                    } else if (destAddr >= 0 && destAddr < nrOfNics) {
+                        SimNic *dest = simNics[static_cast<unsigned int>(destAddr)];
+                        dest->inputValues.push(nic->packet[1]);
+                        dest->inputValues.push(nic->packet[2]);
+                        dest->idle = false;
+                    }
+                    nic->packet.clear();
+                }
+                nic->runProgram();
+            }
+            if (nic->state == P_HALT) {
+                cerr << "NIC #" << nic->pNr << " halted unexpectedly" << endl;
+                exit(1);
+            }
+        }
+
+        if (packetSent || !natHasPacket) {
+            continue;
+        }
         bool idle = true;
-        if (packetX == 0 && packetY == 0) continue;
-        for (auto n : nics) {
-            if (n->isIdle() != true)
-            {
+        for (auto nic : simNics) {
+            if (!nic->idle || !nic->inputValues.empty()) {
                 idle = false;
                 break;
             }
         }
         if (idle) {
-            cout << "NAT Detected Idleness... So sad! Send " << packetX << ":" << packetY << " to 0." << endl;
-            if (seenValues.count(packetY) > 0) {
-                cout << "NAT detected same Y value in a row: " << packetY << endl;
+            if (natSent && lastNatY == natY) {
+                cout << "Solution 2: NAT delivered the same Y value twice in a row: " << natY
+                     << " (after " << rounds << " rounds)" << endl;
                 break;
             }
-            seenValues.insert(packetY);
-            (nics[0])->pushInputValues(packetX, packetY);
-            packetX = 0;
-            packetY = 0;
+            simNics[0]->inputValues.push(natX);
+            simNics[0]->inputValues.push(natY);
+            simNics[0]->idle = false;
+            natSent = true;
+            lastNatY = natY;
         }
     }
+    for (auto nic : simNics) {
+        delete nic;
+    }
 }
 
+/**
+ * Appends a telemetry snapshot of all NICs to the CSV file
+ */
+void writeTelemetrySnapshot(ofstream &out, double timeMs)
+{
+    for (auto n : nics) {
+        out << timeMs << "," << n->pNr << ","
+            << n->telemetry.packetsSent.load(std::memory_order_relaxed) << ","
+            << n->telemetry.packetsReceived.load(std::memory_order_relaxed) << ","
+            << n->telemetry.queueHighWater.load(std::memory_order_relaxed) << ","
+            << n->telemetry.blockedNanos.load(std::memory_order_relaxed) / 1000 << ","
+            << n->telemetry.instructions.load(std::memory_order_relaxed) << ","
+            << nat.injections.load(std::memory_order_relaxed) << "\n";
+    }
+}
 
-void solution1(memory_t &data)
+/**
+ * Multi-threaded mode: one thread per NIC
+ *
+ * If telemetryFile is given, a telemetry snapshot is written every 10ms, and at the end.
+ */
+void runThreaded(memory_t &data, const string &telemetryFile)
 {
     // Create NIC programs
     vector<std::shared_ptr<std::thread>> threads;
     for (unsigned int i = 0; i < 50; i++) {
         auto nic = std::make_shared<Nic>(&data);
-        cout << "Nic " << i << " program size: " << nic->memory->size() << endl;
         nic->pNr = i;
         nic->inputValues.push(cpp_int(i));
+        nat.inFlight++;
         nics.push_back(nic);
-        cout << "Starting nic #" << nic->pNr << endl;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (auto nic : nics) {
         threads.push_back(std::make_shared<std::thread>(std::ref(*nic)));
     }
 
+    // Telemetry writer thread:
+    std::atomic<bool> done{false};
+    std::thread telemetryThread;
+    ofstream telemetryOut;
+    auto elapsedMs = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    if (!telemetryFile.empty()) {
+        telemetryOut.open(telemetryFile);
+        telemetryOut << "time_ms,nic,packets_sent,packets_received,queue_high_water,blocked_us,instructions,nat_injections\n";
+        telemetryThread = std::thread([&]() {
+            while (!done) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                writeTelemetrySnapshot(telemetryOut, elapsedMs());
+            }
+        });
+    }
+
     nat.checkIdle();
 
-    // (threads[0])->join();
+    for (auto t : threads) {
+        t->join();
+    }
+    if (telemetryThread.joinable()) {
+        done = true;
+        telemetryThread.join();
+        writeTelemetrySnapshot(telemetryOut, elapsedMs());
+        cout << "Telemetry written to: " << telemetryFile << endl;
+    }
 }
 
 int main(int argc, char *args[])
@@ -205,6 +447,13 @@ int main(int argc, char *args[])
     memory_t data;
     readIntcodeProgramFromFile(args[1], data);
 
-    solution1(data);
-    // solution2(data);
+    if (argc >= 3 && string("--threaded").compare(args[2]) == 0) {
+        string telemetryFile;
+        if (argc >= 5 && string("--telemetry").compare(args[3]) == 0) {
+            telemetryFile = args[4];
+        }
+        runThreaded(data, telemetryFile);
+    } else {
+        simulate(data);
+    }
 }
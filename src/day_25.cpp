@@ -3,6 +3,10 @@
 #include <vector>
 #include <map>
 #include <queue>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "common.h"
 #include "intcode.h"
 #include <boost/multiprecision/cpp_int.hpp>
@@ -15,156 +19,365 @@ using namespace boost;
 /**
  * Day 25 - Cryostasis
  *
- * A small text adventure in Intcode. This is a combination of manual and programmatic solution:
+ * A small text adventure in Intcode. Solved fully automatic:
  *
- * 1. explore the adventure manually
- * 2. feed inputs and all item combinations programmatically in a 2nd step
+ * 1. explore the ship with a BFS over the doors: Each room is reached by a forked copy
+ *    of the adventure program, so we never have to walk back
+ * 2. test each item on a forked copy before taking it - some of them are deadly
+ * 3. collect all safe items, walk to the security checkpoint
+ * 4. try the item combinations at the pressure-sensitive floor, in Gray code order (so each
+ *    trial differs by one take / drop only), pruned by the "too heavy / too light" feedback
  */
 
-class Adventure : public Program
+// Max. nr of instructions a single command may take - protects from items that loop forever:
+const unsigned long COMMAND_INSTRUCTION_LIMIT = 1000000;
+
+class Adventure : public AsciiProgramBase<Adventure>
 {
     public:
-        Adventure(memory_t *mem) : Program(mem) {}
+        // All output lines since the last command:
+        vector<string> lines;
+
+        Adventure(memory_t *mem) : AsciiProgramBase<Adventure>(mem) {
+            bindSink();
+        }
+
+        /**
+         * Forking: the sink callback must point to the new instance's lines
+         */
+        Adventure(const Adventure &other) : AsciiProgramBase<Adventure>(other), lines{other.lines} {
+            bindSink();
+        }
+
+        Adventure &operator=(const Adventure &other) {
+            AsciiProgramBase<Adventure>::operator=(other);
+            lines = other.lines;
+            bindSink();
+            return *this;
+        }
+
+        /**
+         * Executes a command, and runs the program until it waits for the next command.
+         * Returns false if the program did not come back to the command prompt (halted, or
+         * ran into the instruction limit).
+         */
+        bool command(const string &cmd) {
+            lines.clear();
+            this->asciiInput(cmd);
+            return this->runProgramLimited(COMMAND_INSTRUCTION_LIMIT) && this->state == P_INPUT;
+        }
 
         /**
-         * Asks for input from the command line once the input queue is empty
+         * Did the last command produce an output line containing the given text?
          */
-        virtual cpp_int getInputValue() {
-            if (this->inputValues.size() == 0) {
-                string input;
-                cout << ": ";
-                getline(cin, input);
-                this->asciiInput(input);
+        bool outputContains(const string &text) const {
+            for (auto &l : lines) {
+                if (l.find(text) != string::npos) {
+                    return true;
+                }
             }
-            cpp_int val = this->inputValues.front();
-            this->inputValues.pop();
-            cout << static_cast<char>(val);
-            return val;
+            return false;
         }
+
+    private:
+        void bindSink() {
+            sink.onLine = [this](string_view line) {
+                lines.emplace_back(line);
+            };
+        }
+};
+
+/**
+ * A room, as described by the adventure
+ */
+class Room
+{
+    public:
+        string name;
+        vector<string> doors;
+        vector<string> items;
+        // door -> name of the neighbour room
+        map<string, string> neighbours;
 };
 
 /**
- * Builds a list with all possible combinations of "items". The items here are
- * digits from 1 to (max) 9, so it finds all combinations possible
- * from 1 to 123456789
+ * Parses the last room description in the given output lines.
+ * Returns false if the output contains no room description.
+ */
+bool parseRoom(const vector<string> &lines, Room &room)
+{
+    long start = -1;
+    for (long i = lines.size() - 1; i >= 0; i--) {
+        if (lines[i].substr(0, 3) == "== ") {
+            start = i;
+            break;
+        }
+    }
+    if (start < 0) {
+        return false;
+    }
+    room.name = lines[start].substr(3, lines[start].size() - 6);
+    room.doors.clear();
+    room.items.clear();
+    vector<string> *list = nullptr;
+    for (unsigned long i = start + 1; i < lines.size(); i++) {
+        const string &l = lines[i];
+        if (l == "Doors here lead:") {
+            list = &room.doors;
+        } else if (l == "Items here:") {
+            list = &room.items;
+        } else if (l.substr(0, 2) == "- " && list != nullptr) {
+            list->push_back(l.substr(2));
+        } else {
+            list = nullptr;
+        }
+    }
+    return true;
+}
+
+/**
+ * Tests an item on a forked copy of the adventure (which is in the item's room):
+ * The item is safe if we can take it, and still move through a door afterwards.
+ */
+bool isItemSafe(const Adventure &adventure, const Room &room, const string &item)
+{
+    Adventure fork(adventure);
+    if (!fork.command("take " + item) || !fork.outputContains("You take the")) {
+        return false;
+    }
+    Room next;
+    if (!fork.command(room.doors[0]) || !parseRoom(fork.lines, next)) {
+        return false;
+    }
+    return next.name != room.name;
+}
+
+/**
+ * Finds the shortest list of doors to walk from one room to another, by BFS over the explored rooms
+ */
+vector<string> findWay(map<string, Room> &rooms, const string &from, const string &to)
+{
+    map<string, pair<string, string>> cameFrom; // room -> (prev room, door)
+    queue<string> toVisit;
+    toVisit.push(from);
+    cameFrom[from] = {"", ""};
+    while (!toVisit.empty()) {
+        string act = toVisit.front();
+        toVisit.pop();
+        if (act == to) {
+            break;
+        }
+        for (auto &n : rooms[act].neighbours) {
+            if (cameFrom.count(n.second) == 0) {
+                cameFrom[n.second] = {act, n.first};
+                toVisit.push(n.second);
+            }
+        }
+    }
+    vector<string> way;
+    for (string act = to; act != from; act = cameFrom[act].first) {
+        way.insert(way.begin(), cameFrom[act].second);
+    }
+    return way;
+}
+
+/**
+ * The search state at the security checkpoint, shared by all workers:
+ * Known too heavy / too light item sets, used to prune candidates.
+ */
+class CheckpointSearch
+{
+    public:
+        mutex m;
+        vector<unsigned long> tooHeavy;
+        vector<unsigned long> tooLight;
+        atomic<bool> found{false};
+        vector<string> solutionOutput;
+        atomic<unsigned long> trials{0};
+
+        /**
+         * A superset of a too heavy set is too heavy, a subset of a too light set is too light
+         */
+        bool isPruned(unsigned long items)
+        {
+            lock_guard<mutex> lock(m);
+            for (auto h : tooHeavy) {
+                if ((h & ~items) == 0) {
+                    return true;
+                }
+            }
+            for (auto l : tooLight) {
+                if ((items & ~l) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void addResult(bool heavy, unsigned long items)
+        {
+            lock_guard<mutex> lock(m);
+            (heavy ? tooHeavy : tooLight).push_back(items);
+        }
+};
+
+/**
+ * Tries the item sets with the Gray code indices [from, to) on a fork of the adventure at the checkpoint.
  *
- * This is then used as inventory item index later
+ * In Gray code order, two neighbouring sets differ by exactly one item, so mostly a single
+ * take / drop is needed between two trials. Sets that are pruned by earlier results are skipped.
  */
-void buildAllCombinations(long nr, vector<string> &combs)
+void searchItemSets(Adventure adventure, unsigned long heldItems, unsigned long from, unsigned long to,
+                    const vector<string> &inventory, const string &floorDir, CheckpointSearch &search)
 {
-    long maxNr;
-    string tmp;
-    for (long i = 0; i < nr; i++) {
-        tmp += to_string(nr);
-    }
-    maxNr = stol(tmp);
-    for (long i = 1; i <= maxNr; ++i) {
-        tmp = to_string(i);
-        if (i < 10) {
-            combs.push_back(tmp);
+    for (unsigned long i = from; i < to && !search.found; i++) {
+        unsigned long items = i ^ (i >> 1);
+        if (search.isPruned(items)) {
             continue;
         }
-        bool found = true;
-        for (unsigned int idx = 1; idx < tmp.length(); ++idx) {
-            if (tmp[idx-1] >= tmp[idx] || tmp[idx] > (nr + 48)) {
-                found = false;
-                break;
+        for (unsigned long bit = 0; bit < inventory.size(); bit++) {
+            unsigned long mask = 1ul << bit;
+            if ((items & mask) != (heldItems & mask)) {
+                adventure.command(((items & mask) ? "take " : "drop ") + inventory[bit]);
+            }
+        }
+        heldItems = items;
+        search.trials++;
+        if (!adventure.command(floorDir)) {
+            // Not ejected back to the checkpoint: we're through!
+            if (!search.found.exchange(true)) {
+                search.solutionOutput = adventure.lines;
             }
+            return;
         }
-        if (found == true) {
-            combs.push_back(tmp);
+        if (adventure.outputContains("lighter than the detected")) {
+            search.addResult(true, items);
+        } else if (adventure.outputContains("heavier than the detected")) {
+            search.addResult(false, items);
         }
     }
 }
 
 /**
-*/
-void solution1(memory_t &data)
+ * Explores the ship, collects all safe items and walks to the security checkpoint.
+ *
+ * Returns the direction of the pressure-sensitive floor, seen from the checkpoint,
+ * and fills inventory with the collected items.
+ */
+string exploreShip(Adventure &program, vector<string> &inventory)
 {
+    map<string, Room> rooms;
+    map<string, Adventure *> forks;
+    queue<string> toVisit;
+    string checkpoint;
+    string floorDir;
+
+    program.runProgram();
+    Room start;
+    parseRoom(program.lines, start);
+    rooms[start.name] = start;
+    forks[start.name] = new Adventure(program);
+    toVisit.push(start.name);
+
+    // BFS over the doors, each room gets its own fork:
+    while (!toVisit.empty()) {
+        Room &room = rooms[toVisit.front()];
+        toVisit.pop();
+        for (auto &door : room.doors) {
+            Adventure *fork = new Adventure(*forks[room.name]);
+            Room next;
+            if (!fork->command(door) || !parseRoom(fork->lines, next)) {
+                delete fork;
+                continue;
+            }
+            if (next.name == room.name) {
+                // We were sent back: this is the pressure-sensitive floor, behind the checkpoint
+                checkpoint = room.name;
+                floorDir = door;
+                delete fork;
+                continue;
+            }
+            room.neighbours[door] = next.name;
+            if (rooms.count(next.name) > 0) {
+                delete fork;
+                continue;
+            }
+            rooms[next.name] = next;
+            forks[next.name] = fork;
+            toVisit.push(next.name);
+        }
+    }
+    cout << "Explored " << rooms.size() << " rooms, security checkpoint: " << checkpoint
+         << ", floor is " << floorDir << endl;
+
+    // Find the safe items:
+    vector<pair<string, string>> safeItems; // (room, item)
+    for (auto &it : rooms) {
+        for (auto &item : it.second.items) {
+            if (isItemSafe(*forks[it.first], it.second, item)) {
+                safeItems.push_back({it.first, item});
+            } else {
+                cout << "Dangerous item, leave it: " << item << endl;
+            }
+        }
+    }
+    for (auto &it : forks) {
+        delete it.second;
+    }
+
+    // Collect the safe items with the main program, and walk to the checkpoint:
+    string actRoom = start.name;
+    for (auto &item : safeItems) {
+        for (auto &door : findWay(rooms, actRoom, item.first)) {
+            program.command(door);
+        }
+        actRoom = item.first;
+        program.command("take " + item.second);
+        inventory.push_back(item.second);
+        cout << "Took item: " << item.second << endl;
+    }
+    for (auto &door : findWay(rooms, actRoom, checkpoint)) {
+        program.command(door);
+    }
+    return floorDir;
+}
 
+void solution1(memory_t &data)
+{
     Adventure program(&data);
-    string last_output = "";
-    string input = "";
     vector<string> inventory;
 
-    // as initial walkthrough, we provide a list of (known) commands so far, so that I dont have to enter it manually.
-    // The program uses them, and asks for manual input if the list is done.
-    program.asciiInput("south");
-    program.asciiInput("west");
-    program.asciiInput("north"); // in crew quarters
-    program.asciiInput("take fuel cell");
-    inventory.push_back("fuel cell");
-    program.asciiInput("south");
-    program.asciiInput("east");
-    program.asciiInput("north"); // back on start
-    program.asciiInput("north"); // stables
-    program.asciiInput("east"); // gift wrap center
-    program.asciiInput("take candy cane"); // gift wrap center
-    inventory.push_back("candy cane");
-    program.asciiInput("south");
-    program.asciiInput("take hypercube");
-    inventory.push_back("hypercube");
-    program.asciiInput("north");
-    program.asciiInput("west"); // stables
-    program.asciiInput("north"); // observatory
-    program.asciiInput("take coin");
-    inventory.push_back("coin");
-    program.asciiInput("east");
-    program.asciiInput("take tambourine");
-    inventory.push_back("tambourine");
-    program.asciiInput("west");
-    program.asciiInput("west"); //Arcade
-    program.asciiInput("take spool of cat6");
-    inventory.push_back("spool of cat6");
-    program.asciiInput("north"); // Nav
-    program.asciiInput("take weather machine");
-    inventory.push_back("weather machine");
-    program.asciiInput("west");
-    program.asciiInput("take mutex");
-    inventory.push_back("mutex");
-    program.asciiInput("west"); // security checkpoint
-
-    // Inventory combinations: we have 8 inventory combinations so far,
-    // so build up a list of all possible item combinations:
-    vector<string> invCombinations;
-    cout << "Please stand by, initializing item combinations ..." << endl;
-    buildAllCombinations(inventory.size(), invCombinations);
-    cout << "Found " << invCombinations.size() << " combinations, let's start." << endl;
-
-    // Try any of the item combinations to check whether it takes me to the next room or not:
-    for (auto comb : invCombinations) {
-        // drop all inv items before the security chekpoint:
-        for (auto i : inventory) {
-            program.asciiInput("drop " + i);
-        }
-        // take up the inventory item:
-        for (auto c : comb) {
-            program.asciiInput("take " + inventory[c-49]);
-        }
-
-        // now, head west through the security floor:
-        program.asciiInput("west");
-    }
-
-    // Yes, it did! The following combination lead to a solution:
-    /**
-     * - hypercube
-     * - tambourine
-     * - spool of cat6
-     * - weather machine
-     */
-
-
-    // Run the adventure!
-    while (program.state != P_HALT)
-    {
-        program.runProgram();
-        if (program.output == 10) {
-            last_output = "";
-        } else {
-            last_output += static_cast<char>( program.output );
-        }
-        cout << static_cast<char>(program.output);
+    auto start = chrono::steady_clock::now();
+    string floorDir = exploreShip(program, inventory);
+    if (floorDir.empty()) {
+        cerr << "Could not find the security checkpoint" << endl;
+        exit(1);
+    }
+    cout << "Reached the security checkpoint with " << inventory.size() << " items after "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+    // Try the item sets: The Gray code sequence is split into one block per worker,
+    // each worker starts with its own fork of the adventure:
+    unsigned long nrOfSets = 1ul << inventory.size();
+    unsigned long allItems = nrOfSets - 1;
+    unsigned long nrOfWorkers = min(static_cast<unsigned long>(max(1u, thread::hardware_concurrency())), nrOfSets);
+    unsigned long blockSize = (nrOfSets + nrOfWorkers - 1) / nrOfWorkers;
+    CheckpointSearch search;
+    vector<thread> workers;
+    for (unsigned long w = 0; w < nrOfWorkers; w++) {
+        workers.push_back(thread(searchItemSets, program, allItems, w * blockSize, min(nrOfSets, (w + 1) * blockSize),
+                                 std::cref(inventory), std::cref(floorDir), std::ref(search)));
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+    cout << "Tried " << search.trials << " of " << nrOfSets << " item sets" << endl;
+    if (!search.found) {
+        cerr << "No item set passed the pressure-sensitive floor" << endl;
+        exit(1);
+    }
+    for (auto &l : search.solutionOutput) {
+        cout << l << '\n';
     }
 }
 
@@ -10,20 +10,24 @@
 #include <boost/multiprecision/cpp_int.hpp>
 #include <thread>
 #include <chrono>
+#include <functional>
+#include <string_view>
 
 using namespace boost::multiprecision;
 using namespace boost;
 /**
  * The INTCODE Computer and helper structures, used in a variety of puzzles this year.
  *
- * The Program class represents the Intcode processor.
+ * The Program class represents the Intcode processor (see ProgramBase for
+ * the compile-time customizable variant).
  * Load a memory structure (memory_t) on constructing,
  * and execute runProgram().
  *
- * When runProgram returns, the program is in two possible modes:
+ * When runProgram returns, the program is in one of the following modes:
  *
  * - P_HALT: The program has ended (reached opcode 99)
  * - P_OUTPUT: The program has produced an output (reached opcode 4)
+ * - P_INPUT: The program waits for an input value, but the input queue is empty (opcode 3)
  *
  * After that, you can:
  *
@@ -46,12 +50,14 @@ typedef map<cpp_int, cpp_int>
  * - P_RUN: still running
  * - P_OUTPUT: Program has generated an output, and is halted until continued
  * - P_HALT: The program is done, no furter run
+ * - P_INPUT: Program waits for an input value, and is halted until continued
  */
 enum ProgramResult
 {
     P_RUN,
     P_OUTPUT,
-    P_HALT
+    P_HALT,
+    P_INPUT
 };
 
 /**
@@ -70,7 +76,24 @@ void readIntcodeProgramFromFile(const string &filename, memory_t &memory)
     }
 }
 
-class Program
+/**
+ * The Intcode processor core, as a CRTP template over its in-/output policy:
+ *
+ * The Derived class may shadow getInputValue() / hasInputValue() and / or handleOutputValue() to
+ * customize where input values come from and what happens with output values.
+ * Because the calls are resolved at compile time, the policy is inlined into the
+ * instruction loop - no virtual call per instruction.
+ *
+ * Example:
+ *
+ * class MyDriver : public ProgramBase<MyDriver> {
+ *     public:
+ *         MyDriver(memory_t *mem) : ProgramBase<MyDriver>(mem) {}
+ *         cpp_int getInputValue() { return cpp_int(42); }
+ * };
+ */
+template <class Derived>
+class ProgramBase
 {
     public:
         int pNr = 0;
@@ -80,8 +103,10 @@ class Program
         cpp_int output;
         ProgramResult state;
         cpp_int relativeBase;
+        // Nr of executed instructions, e.g. for statistics:
+        unsigned long executedInstructions = 0;
 
-        Program(memory_t *mem)
+        ProgramBase(const memory_t *mem)
         {
             memory = new memory_t(*mem);
             iPointer = cpp_int(0);
@@ -89,6 +114,52 @@ class Program
             state = P_RUN;
         }
 
+        /**
+         * Copying a program creates an independent snapshot (fork) of it,
+         * including its memory and input queue.
+         */
+        ProgramBase(const ProgramBase &other)
+            : pNr{other.pNr}, memory{new memory_t(*other.memory)}, iPointer{other.iPointer},
+              inputValues{other.inputValues}, output{other.output}, state{other.state},
+              relativeBase{other.relativeBase}, executedInstructions{other.executedInstructions}
+        {
+        }
+
+        /**
+         * Restores a snapshot into this program. The memory map re-uses its allocated nodes.
+         */
+        ProgramBase &operator=(const ProgramBase &other)
+        {
+            if (this != &other)
+            {
+                pNr = other.pNr;
+                *memory = *other.memory;
+                iPointer = other.iPointer;
+                inputValues = other.inputValues;
+                output = other.output;
+                state = other.state;
+                relativeBase = other.relativeBase;
+                executedInstructions = other.executedInstructions;
+            }
+            return *this;
+        }
+
+        /**
+         * Re-loads the given program image into this (already allocated) processor,
+         * and resets it to its start state. The memory map re-uses its allocated nodes,
+         * so this is much cheaper than constructing a new Program.
+         */
+        void reset(const memory_t *mem)
+        {
+            *memory = *mem;
+            iPointer = cpp_int(0);
+            relativeBase = cpp_int(0);
+            output = cpp_int(0);
+            inputValues = queue<cpp_int>();
+            executedInstructions = 0;
+            state = P_RUN;
+        }
+
         void asciiInput(const string& input) {
             for (auto c : input) {
                 this->inputValues.push(cpp_int(c));
@@ -209,12 +280,37 @@ class Program
             }
         }
 
-        virtual cpp_int getInputValue() {
+        /**
+         * Default input policy: Is there an input value in the queue?
+         * If not, the program stops with P_INPUT before executing the input instruction.
+         *
+         * Drivers that override getInputValue() to always deliver a value
+         * should return true here.
+         */
+        bool hasInputValue() {
+            return !this->inputValues.empty();
+        }
+
+        /**
+         * Default input policy: Read the next value from the input queue
+         */
+        cpp_int getInputValue() {
             cpp_int val = this->inputValues.front();
             this->inputValues.pop();
             return val;
         }
 
+        /**
+         * Default output policy: Store the value in output, and interrupt the program.
+         *
+         * Returns true if the program should stop with P_OUTPUT, false
+         * if it should just continue to run.
+         */
+        bool handleOutputValue(const cpp_int &value) {
+            this->output = value;
+            return true;
+        }
+
         /**
          * Executes a single instruction (the next according to the Program's iPointer),
          * sets the output value (if applicable) and sets the iPointer to the next program
@@ -256,7 +352,13 @@ class Program
                     break;
                     // Input instr.
                 case 3:
-                    inputValue = this->getInputValue();
+                    if (!this->derived().hasInputValue())
+                    {
+                        // Wait for input, re-execute this instruction on continue:
+                        this->state = P_INPUT;
+                        break;
+                    }
+                    inputValue = this->derived().getInputValue();
                     storePos = this->getStorePos(this->iPointer + 1, paramModes[0]);
                     data[storePos] = inputValue;
                     this->iPointer += 2;
@@ -264,9 +366,11 @@ class Program
                     // Output instr.
                 case 4:
                     val1 = this->getValue(this->iPointer + 1, paramModes[0]);
-                    this->output = val1;
                     this->iPointer += 2;
-                    this->state = P_OUTPUT;
+                    if (this->derived().handleOutputValue(val1))
+                    {
+                        this->state = P_OUTPUT;
+                    }
                     break;
                     // Jump if true:
                 case 5:
@@ -351,14 +455,229 @@ class Program
             while (this->state == P_RUN)
             {
                 this->executeNextInstruction();
+                // A blocked input instruction did not execute:
+                if (this->state != P_INPUT)
+                {
+                    this->executedInstructions++;
+                }
             }
         }
 
-        virtual ~Program()
+        /**
+         * Like runProgram(), but executes at most maxInstructions instructions.
+         * Returns false if the limit was hit (the program is still in P_RUN then),
+         * e.g. to guard against programs that loop forever.
+         */
+        bool runProgramLimited(unsigned long maxInstructions)
+        {
+            unsigned long limit = this->executedInstructions + maxInstructions;
+            this->state = P_RUN;
+            while (this->state == P_RUN && this->executedInstructions < limit)
+            {
+                this->executeNextInstruction();
+                // A blocked input instruction did not execute:
+                if (this->state != P_INPUT)
+                {
+                    this->executedInstructions++;
+                }
+            }
+            return this->state != P_RUN;
+        }
+
+        ~ProgramBase()
         {
             memory->clear();
             delete memory;
         }
+
+    protected:
+        Derived &derived()
+        {
+            return static_cast<Derived &>(*this);
+        }
+};
+
+/**
+ * The type-erased Intcode processor: in- and output policies are virtual, so
+ * code that needs runtime polymorphism can still override them in a subclass.
+ */
+class Program : public ProgramBase<Program>
+{
+    public:
+        Program(const memory_t *mem) : ProgramBase<Program>(mem) {}
+
+        virtual bool hasInputValue()
+        {
+            return ProgramBase<Program>::hasInputValue();
+        }
+
+        virtual cpp_int getInputValue()
+        {
+            return ProgramBase<Program>::getInputValue();
+        }
+
+        virtual bool handleOutputValue(const cpp_int &value)
+        {
+            return ProgramBase<Program>::handleOutputValue(value);
+        }
+
+        virtual ~Program() {}
+};
+
+/**
+ * Collects the ASCII output of an Intcode program.
+ *
+ * Characters are appended to a reusable line buffer. Each complete line is handed
+ * to onLine (without the newline) as a string_view into that buffer, so it is
+ * only valid during the callback.
+ *
+ * If onFrame is set, non-empty lines are additionally collected into a reusable
+ * 2D frame buffer: A blank line ends the frame, and onFrame is called with the
+ * frame rows and the number of valid rows in it.
+ *
+ * The callbacks usually capture their owner, so they are not copied: A copy (e.g. of a forked
+ * program) gets the pending output, but no callbacks - it has to bind its own. An assigned
+ * sink keeps its own callbacks.
+ */
+class AsciiSink
+{
+    public:
+        function<void(string_view)> onLine;
+        function<void(const vector<string> &, size_t)> onFrame;
+
+        AsciiSink()
+        {
+            line.reserve(256);
+        }
+
+        AsciiSink(const AsciiSink &other) : line{other.line}, frame{other.frame}, frameRows{other.frameRows} {}
+
+        AsciiSink &operator=(const AsciiSink &other)
+        {
+            line = other.line;
+            frame = other.frame;
+            frameRows = other.frameRows;
+            return *this;
+        }
+
+        /**
+         * Consumes an output value if it is an ASCII char.
+         * Returns false if the value is not ASCII, so it must be handled by the caller.
+         */
+        bool put(const cpp_int &value)
+        {
+            if (value < 0 || value > 127)
+            {
+                return false;
+            }
+            char c = static_cast<char>(value);
+            if (c == '\n')
+            {
+                endLine();
+            }
+            else
+            {
+                line.push_back(c);
+            }
+            return true;
+        }
+
+        /**
+         * Emits a pending, not yet newline-terminated line (e.g. on program halt)
+         */
+        void flush()
+        {
+            if (!line.empty())
+            {
+                endLine();
+            }
+        }
+
+    private:
+        string line;
+        vector<string> frame;
+        size_t frameRows = 0;
+
+        void endLine()
+        {
+            if (onLine)
+            {
+                onLine(string_view(line));
+            }
+            if (onFrame)
+            {
+                if (!line.empty())
+                {
+                    // Re-use the row's storage from the last frame:
+                    if (frameRows < frame.size())
+                    {
+                        frame[frameRows].assign(line);
+                    }
+                    else
+                    {
+                        frame.push_back(line);
+                    }
+                    frameRows++;
+                }
+                else if (frameRows > 0)
+                {
+                    onFrame(frame, frameRows);
+                    frameRows = 0;
+                }
+            }
+            line.clear();
+        }
+};
+
+/**
+ * Output policy for text-based Intcode programs: ASCII output is collected in
+ * the sink, without interrupting the program. Only non-ASCII values stop the program
+ * with P_OUTPUT.
+ *
+ * Copying forks the program; the fork's sink has no callbacks yet (see AsciiSink).
+ */
+template <class Derived>
+class AsciiProgramBase : public ProgramBase<Derived>
+{
+    public:
+        AsciiSink sink;
+
+        AsciiProgramBase(const memory_t *mem) : ProgramBase<Derived>(mem) {}
+
+        bool handleOutputValue(const cpp_int &value)
+        {
+            if (sink.put(value))
+            {
+                return false;
+            }
+            this->output = value;
+            return true;
+        }
+
+        void runProgram()
+        {
+            ProgramBase<Derived>::runProgram();
+            if (this->state == P_HALT)
+            {
+                sink.flush();
+            }
+        }
+
+        bool runProgramLimited(unsigned long maxInstructions)
+        {
+            bool done = ProgramBase<Derived>::runProgramLimited(maxInstructions);
+            if (this->state == P_HALT)
+            {
+                sink.flush();
+            }
+            return done;
+        }
+};
+
+class AsciiProgram : public AsciiProgramBase<AsciiProgram>
+{
+    public:
+        AsciiProgram(const memory_t *mem) : AsciiProgramBase<AsciiProgram>(mem) {}
 };
 
 #endif